@@ -25,6 +25,12 @@ Engine::~Engine()
 {
 }
 
+// Plays a stream from a local server's shared ring, the ring must outlive playback
+void Engine::set_local_stream(SharedRing& ring)
+{
+	throw Exception(_("This engine cannot play a local stream"));
+}
+
 void Engine::increment(gboolean forward, gboolean sh)
 {
 	int length = get_length();
@@ -20,6 +20,7 @@
 #define __ENGINE_H__
 
 #include "me-tv-client.h"
+#include "../common/shared_ring.h"
 
 extern gboolean next;
 
@@ -33,6 +34,7 @@ public:
 	virtual ~Engine();
 	
 	virtual void set_mrl(const String& mrl) = 0;
+	virtual void set_local_stream(SharedRing& ring);
 	virtual void set_window(int window) = 0;
 	virtual void play() = 0;
 	virtual void pause(gboolean state) = 0;
@@ -52,6 +52,9 @@ static gboolean on_bus_message (GstBus* bus, GstMessage *message, gpointer data)
 
 GStreamerEngine::GStreamerEngine()
 {
+	local_stream = NULL;
+	stopping = false;
+
 	playbin = gst_element_factory_make("playbin2", "playbin");
 
 	if (!GST_IS_ELEMENT(playbin))
@@ -62,6 +65,8 @@ GStreamerEngine::GStreamerEngine()
 	GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(playbin));
 	gst_bus_add_watch(bus, on_bus_message, NULL);
 	gst_object_unref(bus);
+
+	g_signal_connect(playbin, "source-setup", G_CALLBACK(on_source_setup), this);
 }
 
 GStreamerEngine::~GStreamerEngine()
@@ -100,19 +105,69 @@ void GStreamerEngine::pause(gboolean state)
 
 void GStreamerEngine::play()
 {
+	g_atomic_int_set(&stopping, false);
 	gst_element_set_state(GST_ELEMENT(playbin), GST_STATE_PLAYING);
 }
 
 void GStreamerEngine::stop()
 {
+	// Lets on_need_data() return so that the streaming thread can be stopped
+	g_atomic_int_set(&stopping, true);
 	gst_element_set_state(GST_ELEMENT(playbin), GST_STATE_NULL);
 }
 
 void GStreamerEngine::set_mrl(const String& mrl)
 {
+	local_stream = NULL;
 	g_object_set(G_OBJECT(playbin), "uri", mrl.c_str(), NULL);
 }
 
+// The stream is pushed into an appsrc, one copy out of the ring per buffer
+void GStreamerEngine::set_local_stream(SharedRing& ring)
+{
+	local_stream = &ring;
+	g_object_set(G_OBJECT(playbin), "uri", "appsrc://", NULL);
+}
+
+void GStreamerEngine::on_source_setup(GstElement* playbin, GstElement* source, gpointer data)
+{
+	GStreamerEngine* engine = (GStreamerEngine*)data;
+	if (engine->local_stream == NULL)
+	{
+		return;
+	}
+
+	GstCaps* caps = gst_caps_new_simple("video/mpegts",
+		"systemstream", G_TYPE_BOOLEAN, TRUE,
+		"packetsize", G_TYPE_INT, TS_PACKET_SIZE,
+		NULL);
+	g_object_set(G_OBJECT(source), "caps", caps, "is-live", TRUE, NULL);
+	gst_caps_unref(caps);
+
+	g_signal_connect(source, "need-data", G_CALLBACK(on_need_data), engine);
+}
+
+// Called from the appsrc streaming thread, which waits for a buffer to be pushed
+void GStreamerEngine::on_need_data(GstElement* source, guint length, gpointer data)
+{
+	GStreamerEngine* engine = (GStreamerEngine*)data;
+	GstBuffer* buffer = gst_buffer_new_and_alloc(SHARED_RING_READ_SIZE);
+
+	while (!g_atomic_int_get(&engine->stopping))
+	{
+		gsize count = engine->local_stream->read(GST_BUFFER_DATA(buffer), SHARED_RING_READ_SIZE, 100);
+		if (count > 0)
+		{
+			GstFlowReturn result;
+			GST_BUFFER_SIZE(buffer) = count;
+			g_signal_emit_by_name(source, "push-buffer", buffer, &result);
+			break;
+		}
+	}
+
+	gst_buffer_unref(buffer);
+}
+
 int GStreamerEngine::get_time()
 {
 	GstFormat fmt = GST_FORMAT_TIME;
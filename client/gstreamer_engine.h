@@ -28,11 +28,17 @@ class GStreamerEngine : public Engine
 private:
 	GstElement* playbin;
 	GstElement* videosink;
+	SharedRing*	local_stream;
+	volatile gint	stopping;
+
+	static void on_source_setup(GstElement* playbin, GstElement* source, gpointer data);
+	static void on_need_data(GstElement* source, guint length, gpointer data);
 public:
 	GStreamerEngine();
 	~GStreamerEngine();
 
 	void set_mrl(const String& mrl);
+	void set_local_stream(SharedRing& ring);
 	void set_window(int window);
 	void play();
 	void pause(gboolean state);
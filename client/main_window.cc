@@ -82,6 +82,7 @@ MainWindow::MainWindow(BaseObjectType* cobject, const Glib::RefPtr<Gtk::Builder>
 	channel_change_timeout		= 0;
 	temp_channel_number			= 0;
 	engine						= NULL;
+	local_stream				= NULL;
 	output_fd					= -1;
 	mute_state					= false;
 	
@@ -592,7 +593,14 @@ void MainWindow::play(const String& mrl)
 	if (engine != NULL)
 	{
 		engine->set_window(GDK_WINDOW_XID(drawing_area_video->get_window()->gobj()));
-		engine->set_mrl(mrl);
+		if (local_stream != NULL)
+		{
+			engine->set_local_stream(*local_stream);
+		}
+		else
+		{
+			engine->set_mrl(mrl);
+		}
 		engine->set_volume(volume_button->get_value() * 100);
 		engine->play();
 	}
@@ -753,14 +761,33 @@ void MainWindow::on_start_broadcasting(int channel_id)
 	stop_broadcasting();
 
 	gboolean multicast = configuration_manager.get_boolean_value("multicast");
-	Client::BroadcastingStream stream = client.start_broadcasting(channel_id, multicast);
 
+	// Engines that can be fed from memory take a local server's stream from its
+	// shared ring instead of the loopback interface
+	gboolean local = client.is_local() && (engine_type == "vlc" || engine_type == "gstreamer");
+	Client::BroadcastingStream stream = client.start_broadcasting(channel_id, multicast, local);
+
+	if (stream.protocol == "shm")
+	{
+		try
+		{
+			local_stream = new SharedRing(stream.path);
+		}
+		catch(const Exception& exception)
+		{
+			g_message("Failed to open local stream, falling back to UDP: %s", exception.what().c_str());
+			client.stop_broadcasting();
+			stream = client.start_broadcasting(channel_id, multicast);
+		}
+	}
+
+	// A local stream is played from the ring, see play()
 	String mrl;
-	if (engine_type == "vlc")
+	if (local_stream == NULL && engine_type == "vlc")
 	{
 		mrl = String::compose("%1://@0.0.0.0:%2/", stream.protocol, stream.port);
 	}
-	else
+	else if (local_stream == NULL)
 	{
 		mrl = String::compose("%1://%2:%3/", stream.protocol, stream.address, stream.port);
 	}
@@ -783,6 +810,13 @@ void MainWindow::on_stop_broadcasting()
 		engine = NULL;
 		g_debug("Engine stopped");
 	}
+
+	// Only once the engine has stopped reading it
+	if (local_stream != NULL)
+	{
+		delete local_stream;
+		local_stream = NULL;
+	}
 }
 
 void MainWindow::on_error(const String& message)
@@ -48,6 +48,7 @@ private:
 	ViewMode							prefullscreen_view_mode;
 	guint								timeout_source;
 	Engine*								engine;
+	SharedRing*							local_stream;
 	gint								output_fd;
 	Glib::StaticRecMutex				mutex;
 	gboolean							mute_state;
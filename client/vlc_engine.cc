@@ -31,6 +31,7 @@ VlcEngine::VlcEngine(bool use_ffmpeg_demux)
 {
 	instance		= NULL;
 	media_player	= NULL;
+	local_stream	= NULL;
 
 	int i = 0;
 	const char * vlc_argv[50];
@@ -145,6 +146,40 @@ void VlcEngine::set_mrl(const String& mrl)
 	libvlc_media_release(media);
 }
 
+// The stream is read by VLC's memory input, which calls back for each block from
+// the input thread and copies it out before releasing it
+void VlcEngine::set_local_stream(SharedRing& ring)
+{
+	stop();
+
+	local_stream = &ring;
+
+	libvlc_media_t* media = libvlc_media_new_location(instance, "imem://");
+	libvlc_media_add_option(media, ":imem-cat=4");
+	libvlc_media_add_option(media, ":demux=ts");
+	libvlc_media_add_option(media, String::compose(":imem-data=%1", (gintptr)this).c_str());
+	libvlc_media_add_option(media, String::compose(":imem-get=%1", (gintptr)&on_local_stream_get).c_str());
+	libvlc_media_add_option(media, String::compose(":imem-release=%1", (gintptr)&on_local_stream_release).c_str());
+	libvlc_media_player_set_media(media_player, media);
+	libvlc_media_release(media);
+}
+
+// Returning an empty block lets the input thread check whether it has been stopped
+int VlcEngine::on_local_stream_get(void* data, const char* cookie, int64_t* dts, int64_t* pts,
+	unsigned* flags, size_t* length, void** buffer)
+{
+	VlcEngine* engine = (VlcEngine*)data;
+
+	*length = engine->local_stream->read(engine->local_stream_buffer, SHARED_RING_READ_SIZE, 100);
+	*buffer = engine->local_stream_buffer;
+
+	return 0;
+}
+
+void VlcEngine::on_local_stream_release(void* data, const char* cookie, size_t length, void* buffer)
+{
+}
+
 void VlcEngine::set_time(int time)
 {
 	if (has_media())
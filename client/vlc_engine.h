@@ -29,12 +29,19 @@ private:
 	libvlc_instance_t*		instance;
 	libvlc_media_player_t*	media_player;
 	libvlc_event_manager_t* event_manager;
+	SharedRing*				local_stream;
+	guchar					local_stream_buffer[SHARED_RING_READ_SIZE];
+
+	static int on_local_stream_get(void* data, const char* cookie, int64_t* dts, int64_t* pts,
+		unsigned* flags, size_t* length, void** buffer);
+	static void on_local_stream_release(void* data, const char* cookie, size_t length, void* buffer);
 	
 public:
 	VlcEngine(bool use_ffmpeg_demux = false);
 	~VlcEngine();
 
 	void set_mrl(const String& mrl);
+	void set_local_stream(SharedRing& ring);
 	void set_window(int window);
 	void play();
 	void pause(gboolean state);
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __BIT_READER_H__
+#define __BIT_READER_H__
+
+#include <glib.h>
+
+// Reads big-endian bit fields of up to 32 bits from section data.  The bytes
+// that hold the field are loaded into one word and the field is shifted out of
+// it, rather than being assembled a bit at a time.  Only the bytes covered by
+// the field are read, so a field at the end of a buffer is safe.
+namespace BitReader
+{
+	inline guint get_bits(const guchar* data, guint position, guint count)
+	{
+		data += position >> 3;
+		guint shift = position & 7;
+		guint bytes = (shift + count + 7) >> 3;
+
+		guint64 word = 0;
+		for (guint i = 0; i < bytes; i++)
+		{
+			word = (word << 8) | data[i];
+		}
+
+		return (word >> (bytes * 8 - shift - count)) & ((G_GUINT64_CONSTANT(1) << count) - 1);
+	}
+
+	// For fields at a fixed position, the byte count and shifts are constants
+	// and the loop unrolls into a few loads
+	template<guint position, guint count>
+	inline guint get_bits(const guchar* data)
+	{
+		G_STATIC_ASSERT(count > 0 && count <= 32);
+
+		const guint shift = position & 7;
+		const guint bytes = (shift + count + 7) >> 3;
+
+		data += position >> 3;
+
+		guint64 word = 0;
+		for (guint i = 0; i < bytes; i++)
+		{
+			word = (word << 8) | data[i];
+		}
+
+		return (word >> (bytes * 8 - shift - count)) & ((G_GUINT64_CONSTANT(1) << count) - 1);
+	}
+}
+
+#endif
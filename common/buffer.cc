@@ -75,29 +75,6 @@ void Buffer::clear()
 	length = 0;
 }
 
-guint Buffer::get_bits(guchar* buffer, guint position, gsize count)
-{
-	gsize val = 0;
-
-	for (gsize i = position; i < count + position; i++)
-	{
-		val = val << 1;
-		val = val + ((buffer[i >> 3] & (0x80 >> (i & 7))) ? 1 : 0);
-	}
-	
-	return val;
-}
-
-guint Buffer::get_bits(guint offset, guint position, gsize count) const
-{
-	return get_bits(&buffer[offset], position, count);
-}
-
-guint Buffer::get_bits(guint position, gsize count) const
-{
-	return get_bits(buffer, position, count);
-}
-
 guint32 Buffer::crc32() const
 {
 	return Crc32::calculate(buffer, length);
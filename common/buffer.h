@@ -22,6 +22,7 @@
 #define __BUFFER_H__
 
 #include <glib.h>
+#include "bit_reader.h"
 
 class Buffer
 {
@@ -29,8 +30,6 @@ private:
 	guchar* buffer;
 	gsize length;
 
-	static guint get_bits(guchar* buffer, guint position, gsize count);
-
 public:
 	Buffer();
 	Buffer(gsize length);
@@ -41,8 +40,11 @@ public:
 	void set_length(gsize length);
 	gsize get_length() const { return length; }
 	guchar* get_buffer() const { return buffer; }
-	guint get_bits(guint offset, guint position, gsize count) const;
-	guint get_bits(guint position, gsize count) const;
+	guint get_bits(guint offset, guint position, gsize count) const { return BitReader::get_bits(buffer + offset, position, count); }
+	guint get_bits(guint position, gsize count) const { return BitReader::get_bits(buffer, position, count); }
+
+	template<guint position, guint count>
+	guint get_bits(guint offset = 0) const { return BitReader::get_bits<position, count>(buffer + offset); }
 	guint32 crc32() const;
 
 	guchar operator[](int index) const { return buffer[index]; };
@@ -22,7 +22,10 @@
 #include "dvb_si.h"
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <net/if.h>
+#include <algorithm>
 #include "exception.h"
+#include "common.h"
 
 class Lock : public Glib::RecMutex::Lock
 {
@@ -32,11 +35,65 @@ public:
 	~Lock() {}
 };
 
-ChannelStream::ChannelStream(ChannelStreamType t, Channel& c) : channel(c)
+ChannelStream::ChannelStream(ChannelStreamType t, Channel& c) : writer(*this), channel(c)
 {
 	g_static_rec_mutex_init(mutex.gobj());
 	type = t;
-	last_insert_time = 0;
+	video_pid = NULL_PID;
+	video_type = 0;
+	psi_version = 0;
+	psi_pcr_pid = NULL_PID;
+	psi_pcr = 0;
+	psi_pcr_valid = false;
+	psi_packet_count = PSI_INTERVAL_PACKETS;
+	pat_counter = 0;
+	pmt_counter = 0;
+	overflow_count = 0;
+	writer_waiting = false;
+
+	g_static_mutex_init(gop_mutex.gobj());
+	gop_block_count = 0;
+	gop_last_position = 0;
+	gop_valid = false;
+	gop_reset = false;
+	first_position_valid = false;
+	first_position = 0;
+}
+
+// Replaces the elementary streams from a PMT section, safe while the writer is running
+void ChannelStream::set_layout(guint pmt_pid, const Buffer& section, gboolean ignore_teletext)
+{
+	Lock lock(mutex, "ChannelStream::set_layout()");
+	stream.clear();
+	stream.set_pmt_pid(pmt_pid);
+	stream.parse_pms(section, ignore_teletext);
+}
+
+void ChannelStream::start()
+{
+	if (!writer.is_started())
+	{
+		writer.start();
+	}
+}
+
+// Must be called by the destructor of derived classes, before the objects that
+// write_data() uses are destroyed
+void ChannelStream::stop()
+{
+	writer.terminate();
+	wake_writer();
+	writer.join(true);
+
+	PacketSlice* slice = NULL;
+	while ((slice = queue.front()) != NULL)
+	{
+		slice->block->unreference();
+		queue.pop();
+	}
+
+	Glib::Mutex::Lock lock(gop_mutex);
+	clear_gop();
 }
 
 String BroadcastingChannelStream::get_description()
@@ -44,13 +101,11 @@ String BroadcastingChannelStream::get_description()
 	return channel.get_text();
 }
 
-BroadcastingChannelStream::BroadcastingChannelStream(Channel& c, int id, const String& i, const String& a, int p) :
-	ChannelStream(CHANNEL_STREAM_TYPE_BROADCAST, c), client_id(id), interface(i), address(a), port(p)
+BroadcastingChannelStream::BroadcastingChannelStream(Channel& c, const String& i) :
+	ChannelStream(CHANNEL_STREAM_TYPE_BROADCAST, c), sd(socket(AF_INET, SOCK_DGRAM, 0)), interface(i), live_sender(sd, pace_output)
 {
 	int broadcast = 1;
 
-	sd = socket(AF_INET, SOCK_DGRAM, 0);
-
 	if (sd < 0)
 	{
 		throw SystemException("Failed to create socket");
@@ -58,15 +113,461 @@ BroadcastingChannelStream::BroadcastingChannelStream(Channel& c, int id, const S
 
 	if ((setsockopt(sd, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof broadcast)) == -1)
 	{
+		::close(sd);
 		throw SystemException("Failed to set broadcasting option");
 	}
 
-	recvaddr.sin_family = AF_INET;
-	recvaddr.sin_port = htons(port);
-	recvaddr.sin_addr.s_addr = inet_addr(address.c_str());
-	memset(recvaddr.sin_zero,'\0',sizeof recvaddr.sin_zero);
+	unsigned char ttl = CLAMP(multicast_ttl, 1, 255);
+	if (setsockopt(sd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == -1)
+	{
+		::close(sd);
+		throw SystemException("Failed to set multicast TTL");
+	}
+
+	// The interface can be given by address or by name
+	if (!interface.empty())
+	{
+		struct ip_mreqn request;
+		memset(&request, 0, sizeof(request));
+		if (inet_aton(interface.c_str(), &request.imr_address) == 0)
+		{
+			request.imr_ifindex = if_nametoindex(interface.c_str());
+			if (request.imr_ifindex == 0)
+			{
+				::close(sd);
+				throw SystemException(String::compose("Unknown multicast interface '%1'", interface));
+			}
+		}
+
+		if (setsockopt(sd, IPPROTO_IP, IP_MULTICAST_IF, &request, sizeof(request)) == -1)
+		{
+			::close(sd);
+			throw SystemException("Failed to set multicast interface");
+		}
+	}
+
+	g_static_mutex_init(destinations_mutex.gobj());
+
+	timeshift_buffer = NULL;
+	if (timeshift_size > 0)
+	{
+		timeshift_buffer = new TimeshiftBuffer((guint64)timeshift_size * 1024 * 1024);
+	}
+
+	g_debug("Added new broadcast stream '%s'", channel.name.c_str());
+}
+
+// Adds a client to the stream and returns the port it will be sent to.  Multicast
+// clients of the same protocol share a single group send, on the port of the
+// first of them.
+int BroadcastingChannelStream::add_client(int client_id, const String& address, int port, gboolean multicast, gboolean rtp)
+{
+	Glib::Mutex::Lock lock(destinations_mutex);
+
+	Destination destination;
+	destination.client_id = client_id;
+	destination.multicast = multicast;
+	destination.primed = false;
+	destination.timeshift_state = TIMESHIFT_STATE_LIVE;
+	destination.timeshift_position = 0;
+	destination.sender = NULL;
+	destination.sink = NULL;
+	destination.owns_sink = false;
+
+	memset(&destination.target.address, 0, sizeof(destination.target.address));
+	destination.target.address.sin_family = AF_INET;
+	destination.target.address.sin_port = htons(port);
+	destination.target.address.sin_addr.s_addr = inet_addr(address.c_str());
+	destination.target.rtp = rtp;
+
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		if (multicast && i->multicast && i->target.rtp == rtp)
+		{
+			// Group members already get the live stream, there is nothing to prime
+			destination.target = i->target;
+			destination.primed = true;
+			break;
+		}
+	}
+
+	destinations.push_back(destination);
+	update_live_destinations();
+
+	g_debug("Added client %d to broadcast stream '%s' -> %s://%s:%d", client_id, channel.name.c_str(),
+		rtp ? "rtp" : "udp", inet_ntoa(destination.target.address.sin_addr), ntohs(destination.target.address.sin_port));
+
+	return ntohs(destination.target.address.sin_port);
+}
+
+// Unless the stream is given ownership, the sink belongs to the caller and must
+// outlive the client
+void BroadcastingChannelStream::add_client(int client_id, StreamSink* sink, gboolean owns_sink)
+{
+	Glib::Mutex::Lock lock(destinations_mutex);
+
+	Destination destination;
+	destination.client_id = client_id;
+	destination.multicast = false;
+	destination.primed = false;
+	destination.timeshift_state = TIMESHIFT_STATE_LIVE;
+	destination.timeshift_position = 0;
+	destination.sender = NULL;
+	destination.sink = sink;
+	destination.owns_sink = owns_sink;
+	memset(&destination.target, 0, sizeof(destination.target));
+
+	destinations.push_back(destination);
+
+	g_debug("Added client %d to broadcast stream '%s' -> sink", client_id, channel.name.c_str());
+}
+
+void BroadcastingChannelStream::remove_client(int client_id)
+{
+	Glib::Mutex::Lock lock(destinations_mutex);
+
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		if (i->client_id == client_id)
+		{
+			delete i->sender;
+			if (i->owns_sink)
+			{
+				delete i->sink;
+			}
+			destinations.erase(i);
+			update_live_destinations();
+			g_debug("Removed client %d from broadcast stream '%s'", client_id, channel.name.c_str());
+			return;
+		}
+	}
+}
+
+gboolean BroadcastingChannelStream::has_client(int client_id)
+{
+	Glib::Mutex::Lock lock(destinations_mutex);
+
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		if (i->client_id == client_id)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+gboolean BroadcastingChannelStream::has_clients()
+{
+	Glib::Mutex::Lock lock(destinations_mutex);
+	return !destinations.empty();
+}
+
+BroadcastingChannelStream::Destination& BroadcastingChannelStream::get_destination(int client_id)
+{
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		if (i->client_id == client_id)
+		{
+			return *i;
+		}
+	}
+
+	throw Exception(String::compose("Client %1 not found", client_id));
+}
+
+// Called with the destinations locked.  Whatever the live sender has queued is
+// sent first so that a client never misses or repeats data when it joins or
+// leaves the live send.
+void BroadcastingChannelStream::update_live_destinations()
+{
+	DatagramDestinationList targets;
+
+	// Members of a multicast group share one target
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		if (i->sink == NULL && i->primed && i->timeshift_state == TIMESHIFT_STATE_LIVE &&
+			std::find(targets.begin(), targets.end(), i->target) == targets.end())
+		{
+			targets.push_back(i->target);
+		}
+	}
+
+	try
+	{
+		live_sender.flush(true);
+	}
+	catch(...)
+	{
+		g_debug("Failed to flush");
+	}
+
+	live_sender.set_destinations(targets);
+}
+
+// Called on the writer thread, sends new unicast clients the PAT/PMT and the
+// cached GOP before they join the live send
+void BroadcastingChannelStream::prime_destinations()
+{
+	gboolean changed = false;
+
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		Destination& destination = *i;
+		if (destination.primed)
+		{
+			continue;
+		}
+
+		std::vector<guchar> data;
+		get_start_data(data);
+		if (destination.sink != NULL)
+		{
+			if (!data.empty())
+			{
+				destination.sink->write(&data[0], data.size());
+			}
+		}
+		else if (!data.empty())
+		{
+			DatagramSender sender(sd);
+			sender.set_destinations(DatagramDestinationList(1, destination.target));
+			try
+			{
+				sender.write(&data[0], data.size());
+				sender.flush(true);
+			}
+			catch(...)
+			{
+				g_debug("Failed to prime client %d", destination.client_id);
+			}
+		}
+
+		destination.primed = true;
+		changed = true;
+	}
+
+	if (changed)
+	{
+		update_live_destinations();
+	}
+}
+
+// Live data is copied into the datagrams once and sent to every live client.
+// With a time-shift buffer everything also goes through the buffer, and paused
+// or shifted clients are sent whatever is at their own cursor.  A shifted client
+// is fed at the live input rate until it catches up.
+void BroadcastingChannelStream::write_data(guchar* buffer, gsize length)
+{
+	Glib::Mutex::Lock lock(destinations_mutex);
+
+	prime_destinations();
+
+	// A destination that cannot be sent to must not hold back the other outputs
+	try
+	{
+		live_sender.write(buffer, length);
+	}
+	catch(const Exception& exception)
+	{
+		g_debug("Failed to send live data: %s", exception.what().c_str());
+	}
+
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		if (i->sink != NULL)
+		{
+			i->sink->write(buffer, length);
+		}
+	}
+
+	if (timeshift_buffer == NULL)
+	{
+		return;
+	}
+
+	timeshift_buffer->write(buffer, length);
+
+	gboolean changed = false;
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		Destination& destination = *i;
+		if (destination.timeshift_state != TIMESHIFT_STATE_SHIFTED)
+		{
+			continue;
+		}
+
+		gsize remaining = length;
+		while (remaining > 0)
+		{
+			gsize size = timeshift_buffer->read(destination.timeshift_position, timeshift_data, MIN(remaining, sizeof(timeshift_data)));
+			if (size == 0)
+			{
+				break;
+			}
+			try
+			{
+				destination.sender->write(timeshift_data, size);
+			}
+			catch(const Exception& exception)
+			{
+				g_debug("Failed to send to time-shifted client %d: %s", destination.client_id, exception.what().c_str());
+			}
+			remaining -= size;
+		}
+
+		if (destination.timeshift_position == timeshift_buffer->get_write_position())
+		{
+			g_debug("Time-shifted client %d has caught up with the live stream", destination.client_id);
+			try
+			{
+				destination.sender->flush(true);
+			}
+			catch(const Exception& exception)
+			{
+				g_debug("Failed to flush time-shifted client %d: %s", destination.client_id, exception.what().c_str());
+			}
+			delete destination.sender;
+			destination.sender = NULL;
+			destination.timeshift_state = TIMESHIFT_STATE_LIVE;
+			changed = true;
+		}
+	}
+
+	if (changed)
+	{
+		update_live_destinations();
+	}
+}
+
+void BroadcastingChannelStream::timeshift(int client_id, TimeshiftAction action, guint seconds)
+{
+	if (timeshift_buffer == NULL)
+	{
+		throw Exception(_("Time-shifting is not enabled"));
+	}
+
+	Glib::Mutex::Lock lock(destinations_mutex);
+
+	Destination& destination = get_destination(client_id);
+	if (destination.multicast || destination.sink != NULL)
+	{
+		throw Exception(_("Time-shifting is only available to unicast and broadcast clients"));
+	}
+
+	// Leaving the live send, the client's cursor starts at the live position
+	if (action != TIMESHIFT_ACTION_LIVE && destination.timeshift_state == TIMESHIFT_STATE_LIVE)
+	{
+		destination.sender = new DatagramSender(sd, pace_output);
+		destination.sender->set_destinations(DatagramDestinationList(1, destination.target));
+		destination.timeshift_position = timeshift_buffer->get_write_position();
+		destination.timeshift_state = TIMESHIFT_STATE_SHIFTED;
+		update_live_destinations();
+	}
+
+	switch (action)
+	{
+	case TIMESHIFT_ACTION_PAUSE:
+		destination.timeshift_state = TIMESHIFT_STATE_PAUSED;
+		break;
 
-	g_debug("Added new channel stream '%s' -> '%s:%d'", channel.name.c_str(), address.c_str(), port);
+	case TIMESHIFT_ACTION_PLAY:
+		destination.timeshift_state = TIMESHIFT_STATE_SHIFTED;
+		break;
+
+	case TIMESHIFT_ACTION_SEEK:
+		{
+			// Seconds are counted back from the live position, the buffer has no
+			// timestamps so the average input rate is used to find the offset
+			guint64 write_position = timeshift_buffer->get_write_position();
+			guint64 offset = (guint64)seconds * timeshift_buffer->get_byte_rate();
+			guint64 position = offset < write_position ? write_position - offset : 0;
+
+			position -= position % TS_PACKET_SIZE;
+			destination.timeshift_position = MAX(position, timeshift_buffer->get_oldest_position());
+			destination.timeshift_state = TIMESHIFT_STATE_SHIFTED;
+		}
+		break;
+
+	case TIMESHIFT_ACTION_LIVE:
+		if (destination.timeshift_state != TIMESHIFT_STATE_LIVE)
+		{
+			delete destination.sender;
+			destination.sender = NULL;
+			destination.timeshift_state = TIMESHIFT_STATE_LIVE;
+			update_live_destinations();
+		}
+		break;
+	}
+}
+
+void BroadcastingChannelStream::flush_data()
+{
+	Glib::Mutex::Lock lock(destinations_mutex);
+
+	prime_destinations();
+
+	try
+	{
+		live_sender.flush();
+	}
+	catch(const Exception& exception)
+	{
+		g_debug("Failed to send live data: %s", exception.what().c_str());
+	}
+
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		if (i->sender != NULL)
+		{
+			try
+			{
+				i->sender->flush();
+			}
+			catch(const Exception& exception)
+			{
+				g_debug("Failed to send to time-shifted client %d: %s", i->client_id, exception.what().c_str());
+			}
+		}
+	}
+}
+
+String BroadcastingChannelStream::get_statistics()
+{
+	Glib::Mutex::Lock lock(destinations_mutex);
+
+	guint shifted = 0;
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		if (i->timeshift_state != TIMESHIFT_STATE_LIVE)
+		{
+			shifted++;
+		}
+	}
+
+	return String::compose("clients=\"%1\" timeshifted_clients=\"%2\"", destinations.size(), shifted);
+}
+
+BroadcastingChannelStream::~BroadcastingChannelStream()
+{
+	stop();
+
+	for (DestinationList::iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		delete i->sender;
+		if (i->owns_sink)
+		{
+			delete i->sink;
+		}
+	}
+
+	if (pace_output)
+	{
+		datagram_pacer.cancel(sd);
+	}
+	::close(sd);
+	delete timeshift_buffer;
 }
 
 RecordingChannelStream::RecordingChannelStream(Channel& c, gboolean scheduled, const String& m, const String& d) :
@@ -74,103 +575,371 @@ RecordingChannelStream::RecordingChannelStream(Channel& c, gboolean scheduled, c
 {
 	mrl = m;
 	description = d;
+	open_recording();
 
 	g_debug("Added new channel stream '%s' -> '%s'", channel.name.c_str(), mrl.c_str());
 }
 
+RecordingChannelStream::RecordingChannelStream(ChannelStreamType t, Channel& c, const String& m, const String& d) :
+	ChannelStream(t, c)
+{
+	mrl = m;
+	description = d;
+	open_recording();
+
+	g_debug("Added new channel stream '%s' -> '%s'", channel.name.c_str(), mrl.c_str());
+}
+
+void RecordingChannelStream::open_recording()
+{
+	recording_writer = NULL;
+	seek_index = NULL;
+	segment_playlist = NULL;
+	segment_index = 0;
+	last_pts = 0;
+	last_pts_valid = false;
+
+	// A multiplex recording has no single video stream to index or to split at
+	if (type == CHANNEL_STREAM_TYPE_MULTIPLEX_RECORDING)
+	{
+		recording_writer = new RecordingWriter(mrl, &statistics);
+	}
+	else if (segment_duration > 0 || segment_size > 0)
+	{
+		segment_playlist = new SegmentPlaylist(SegmentPlaylist::get_path(mrl));
+		start_segment(false);
+	}
+	else
+	{
+		recording_writer = new RecordingWriter(mrl, &statistics);
+		seek_index = new SeekIndex(SeekIndex::get_path(mrl));
+	}
+}
+
+// Opens the next segment, starting it with the PAT and PMT so that it can be
+// played on its own, and adds the previous one to the playlist.  A segment that
+// starts at a video random access point is timed from that packet's PTS, which
+// is last_pts.  If the new segment cannot be opened the current one is kept and
+// false is returned, only the first segment of a recording has to open.
+gboolean RecordingChannelStream::start_segment(gboolean at_video)
+{
+	String path = SegmentPlaylist::get_segment_path(mrl, segment_index);
+	RecordingWriter* writer = NULL;
+	SeekIndex* index = NULL;
+	try
+	{
+		writer = new RecordingWriter(path, &statistics);
+		index = new SeekIndex(SeekIndex::get_path(path));
+	}
+	catch(const Glib::Exception& exception)
+	{
+		delete writer;
+		if (recording_writer == NULL)
+		{
+			throw;
+		}
+
+		g_message("Failed to start recording segment '%s', continuing '%s': %s",
+			path.c_str(), segment_path.c_str(), exception.what().c_str());
+		return false;
+	}
+
+	if (recording_writer != NULL)
+	{
+		segment_playlist->add(segment_path, get_segment_duration());
+		delete seek_index;
+		delete recording_writer;
+	}
+
+	recording_writer = writer;
+	seek_index = index;
+	segment_path = path;
+	segment_index++;
+	segment_start_time = g_get_monotonic_time();
+	segment_start_pts = last_pts;
+	segment_start_pts_valid = at_video && last_pts_valid;
+
+	std::vector<guchar> psi;
+	get_psi(psi);
+	if (!psi.empty())
+	{
+		recording_writer->write(&psi[0], psi.size());
+	}
+
+	g_debug("Recording segment '%s'", segment_path.c_str());
+
+	return true;
+}
+
+// The length of the current segment up to the last video PTS seen, or for a
+// stream without video up to now
+gdouble RecordingChannelStream::get_segment_duration()
+{
+	if (segment_start_pts_valid && last_pts_valid)
+	{
+		return ((last_pts - segment_start_pts) & G_GUINT64_CONSTANT(0x1FFFFFFFF)) / 90000.0;
+	}
+
+	return (g_get_monotonic_time() - segment_start_time) / (gdouble)G_USEC_PER_SEC;
+}
+
+// Decides whether a new segment should start at the current position, which is
+// a video random access point when the stream has video
+gboolean RecordingChannelStream::is_segment_due(gsize pending)
+{
+	guint64 size = recording_writer->get_position() + pending;
+
+	return (segment_duration > 0 && get_segment_duration() >= segment_duration) ||
+		(segment_size > 0 && size >= (guint64)segment_size * 1024 * 1024);
+}
+
 String RecordingChannelStream::get_description()
 {
 	return description;
 }
 
-void ChannelStream::clear_demuxers()
+void RecordingChannelStream::write_data(guchar* buffer, gsize length)
 {
-	Lock lock(mutex, "ChannelStream::clear_demuxers()");
-	
-	g_debug("Removing demuxers");
-	while (!demuxers.empty())
+	guchar* start = buffer;
+
+	// Without video any packet boundary will do for a new segment
+	if (segment_playlist != NULL && video_pid == NULL_PID && is_segment_due(0))
+	{
+		start_segment(false);
+	}
+
+	if (video_pid != NULL_PID && seek_index != NULL)
 	{
-		Dvb::Demuxer* demuxer = demuxers.front();
-		demuxers.pop_front();
-		delete demuxer;
-		g_debug("Demuxer removed");
+		for (gsize offset = 0; offset + TS_PACKET_SIZE <= length; offset += TS_PACKET_SIZE)
+		{
+			guchar* packet = buffer + offset;
+			if (!(packet[1] & 0x40) || Mpeg::get_pid(packet) != video_pid)
+			{
+				continue;
+			}
+
+			guint64 pts = 0;
+			if (Mpeg::get_pts(packet, pts))
+			{
+				last_pts = pts;
+				last_pts_valid = true;
+				if (!segment_start_pts_valid)
+				{
+					segment_start_pts = pts;
+					segment_start_pts_valid = true;
+				}
+			}
+
+			// If the new segment cannot be opened the rest of the data stays in this one
+			if (segment_playlist != NULL && Mpeg::is_random_access(packet, video_type) &&
+				is_segment_due(packet - start))
+			{
+				recording_writer->write(start, packet - start);
+				start = packet;
+				start_segment(true);
+			}
+
+			seek_index->add(recording_writer->get_position() + (packet - start), packet, video_type);
+		}
 	}
+
+	recording_writer->write(start, buffer + length - start);
 }
 
-Dvb::Demuxer& ChannelStream::add_pes_demuxer(const String& demux_path,
-	guint pid, dmx_pes_type_t pid_type, const gchar* type_text)
-{	
-	Lock lock(mutex, "ChannelStream::add_pes_demuxer()");
-	Dvb::Demuxer* demuxer = new Dvb::Demuxer(demux_path);
-	demuxers.push_back(demuxer);
-	g_debug("Setting %s PID filter to %d (0x%X)", type_text, pid, pid);
-	demuxer->set_pes_filter(pid, pid_type);
-	return *demuxer;
+void RecordingChannelStream::flush_data()
+{
+	if (recording_writer->flush() && seek_index != NULL)
+	{
+		seek_index->flush();
+	}
 }
 
-Dvb::Demuxer& ChannelStream::add_section_demuxer(const String& demux_path, guint pid, guint id)
-{	
-	Lock lock(mutex, "FrontendThread::add_section_demuxer()");
-	Dvb::Demuxer* demuxer = new Dvb::Demuxer(demux_path);
-	demuxers.push_back(demuxer);
-	demuxer->set_filter(pid, id);
-	return *demuxer;
+// Called from other threads, so the statistics are kept by the stream rather than
+// by the writer of the current segment
+String RecordingChannelStream::get_statistics()
+{
+	return statistics.get_text();
 }
 
-void BroadcastingChannelStream::write_data(guchar* buffer, gsize length)
+RecordingChannelStream::~RecordingChannelStream()
 {
-	if (::sendto(sd, buffer, length, 0, (struct sockaddr*)&recvaddr, sizeof(recvaddr)) < 0)
+	stop();
+	delete recording_writer;
+	delete seek_index;
+
+	if (segment_playlist != NULL)
 	{
-		throw SystemException("Failed to send data");
+		segment_playlist->add(segment_path, get_segment_duration());
+		delete segment_playlist;
 	}
 }
 
-void RecordingChannelStream::write_data(guchar* buffer, gsize length)
+// The most recently injected PAT and PMT, only valid on the writer thread
+void ChannelStream::get_psi(std::vector<guchar>& data)
 {
-	if (!output_channel)
+	data.clear();
+	if (psi_version == 0)
 	{
-		output_channel = Glib::IOChannel::create_from_file(mrl, "w");
-		output_channel->set_encoding("");
-		output_channel->set_flags(output_channel->get_flags() & Glib::IO_FLAG_NONBLOCK);
-		output_channel->set_buffer_size(TS_PACKET_SIZE * PACKET_BUFFER_SIZE);
+		return;
 	}
 
-	gsize bytes_written = 0;
-	output_channel->write((const gchar*)buffer, length, bytes_written);
+	data.insert(data.end(), pat_packet, pat_packet + TS_PACKET_SIZE);
+	data.insert(data.end(), pmt_packet, pmt_packet + TS_PACKET_SIZE);
 }
 
-BroadcastingChannelStream::~BroadcastingChannelStream()
+// The PAT, PMT and cached GOP that a new client of the stream should start with,
+// only valid on the writer thread
+void ChannelStream::get_start_data(std::vector<guchar>& data)
 {
-	::close(sd);
+	get_psi(data);
+	if (data.empty())
+	{
+		return;
+	}
+
+	Glib::Mutex::Lock lock(gop_mutex);
+	for (std::vector<PacketSlice>::iterator i = gop_slices.begin(); i != gop_slices.end(); i++)
+	{
+		data.insert(data.end(), i->get_data(), i->get_data() + i->length);
+	}
 }
 
-RecordingChannelStream::~RecordingChannelStream()
+// Called by the frontend thread for each packet of a block that belongs to
+// this stream.  Consecutive packets are collected into a single slice.
+void ChannelStream::write(PacketBlock* block, guint offset)
 {
-	if (output_channel)
+	if (!g_atomic_int_get(&first_position_valid))
 	{
-		output_channel.reset();
+		first_position = block->sequence * PACKET_BUFFER_SIZE + offset / TS_PACKET_SIZE;
+		g_atomic_int_set(&first_position_valid, true);
+	}
+
+	if (pending_slice.block == block && pending_slice.offset + pending_slice.length == offset)
+	{
+		pending_slice.length += TS_PACKET_SIZE;
+	}
+	else
+	{
+		commit();
+		pending_slice = PacketSlice(block, offset, TS_PACKET_SIZE);
 	}
 }
 
-void ChannelStream::write(guchar* buffer, gsize length)
+// Called by the frontend thread, queues the pending slice for the writer
+// thread and never blocks.  Slices that do not fit into the queue are dropped
+// and counted.
+void ChannelStream::commit()
 {
-	try
+	if (pending_slice.block == NULL)
+	{
+		return;
+	}
+
+	pending_slice.block->reference();
+	if (queue.push(pending_slice))
 	{
-		time_t now = time(NULL);
-		if (now - last_insert_time > 2)
+		wake_writer();
+	}
+	else
+	{
+		pending_slice.block->unreference();
+
+		guint packets = pending_slice.length / TS_PACKET_SIZE;
+		guint previous = g_atomic_int_exchange_and_add(&overflow_count, packets);
+		if (previous / 1000 != (previous + packets) / 1000)
 		{
-			last_insert_time = now;
+			g_message("Channel stream '%s' queue overflow (%u packets dropped)",
+				channel.name.c_str(), get_overflow_count());
+		}
+	}
 
-			guchar data[TS_PACKET_SIZE];
+	pending_slice = PacketSlice();
+}
 
-			stream.build_pat(data);
-			write_data(data, TS_PACKET_SIZE);
+// The PAT and PMT go out every PSI_INTERVAL_PCR of PCR time, or every
+// PSI_INTERVAL_PACKETS packets for streams without a usable PCR
+gboolean ChannelStream::is_psi_due(const guchar* packet)
+{
+	if (psi_packet_count >= PSI_INTERVAL_PACKETS)
+	{
+		return true;
+	}
+
+	guint64 pcr = 0;
+	if (Mpeg::get_pid(packet) != psi_pcr_pid || !Mpeg::get_pcr(packet, pcr))
+	{
+		return false;
+	}
+
+	// Wraps at 33 bits, a discontinuity just causes an early injection
+	if (psi_pcr_valid && ((pcr - psi_pcr) & G_GUINT64_CONSTANT(0x1FFFFFFFF)) < PSI_INTERVAL_PCR)
+	{
+		return false;
+	}
+
+	psi_pcr = pcr;
+	psi_pcr_valid = true;
+
+	return true;
+}
 
-			stream.build_pmt(data);
-			write_data(data, TS_PACKET_SIZE);
+// The PAT and PMT packets are only rebuilt when the stream layout changes, each
+// injection just patches the continuity counters
+void ChannelStream::write_psi()
+{
+	{
+		Lock lock(mutex, "ChannelStream::write_psi()");
+		if (psi_version != stream.get_version())
+		{
+			stream.build_pat(pat_packet);
+			stream.build_pmt(pmt_packet);
+			psi_version = stream.get_version();
+			psi_pcr_pid = stream.get_pcr_pid();
+			video_pid = stream.video_streams.empty() ? NULL_PID : stream.video_streams[0].pid;
+			video_type = stream.video_streams.empty() ? 0 : stream.video_streams[0].type;
+			gop_reset = true;
+		}
+	}
+
+	pat_packet[3] = 0x10 | (pat_counter++ & 0x0f);
+	pmt_packet[3] = 0x10 | (pmt_counter++ & 0x0f);
+
+	write_data(pat_packet, TS_PACKET_SIZE);
+	write_data(pmt_packet, TS_PACKET_SIZE);
+
+	psi_packet_count = 0;
+}
+
+void ChannelStream::write_packet(const PacketSlice& slice)
+{
+	try
+	{
+		// The whole multiplex already carries its own PAT and PMTs
+		if (type == CHANNEL_STREAM_TYPE_MULTIPLEX_RECORDING)
+		{
+			write_data(slice.get_data(), slice.length);
+			return;
 		}
 
-		write_data(buffer, length);
+		guchar* buffer = slice.get_data();
+		guchar* start = buffer;
+		guchar* end = buffer + slice.length;
+
+		for (guchar* packet = buffer; packet < end; packet += TS_PACKET_SIZE)
+		{
+			if (is_psi_due(packet))
+			{
+				if (packet > start)
+				{
+					write_slice(PacketSlice(slice.block, slice.offset + (start - buffer), packet - start));
+					start = packet;
+				}
+				write_psi();
+			}
+			psi_packet_count++;
+		}
+
+		write_slice(PacketSlice(slice.block, slice.offset + (start - buffer), end - start));
 	}
 	catch(...)
 	{
@@ -178,3 +947,186 @@ void ChannelStream::write(guchar* buffer, gsize length)
 	}
 }
 
+// The GOP cache always holds everything written so far, so a client primed by
+// the next write_data() starts exactly where the live data continues
+void ChannelStream::write_slice(const PacketSlice& slice)
+{
+	write_data(slice.get_data(), slice.length);
+	cache_gop(slice);
+}
+
+// Keeps the input packets since the last video random access point so that a
+// new client for the same channel can be started with a complete GOP.  The cache
+// holds references to the input blocks rather than copies of the packets.
+void ChannelStream::cache_gop(const PacketSlice& slice)
+{
+	Glib::Mutex::Lock lock(gop_mutex);
+
+	if (gop_reset)
+	{
+		clear_gop();
+		gop_valid = false;
+		gop_reset = false;
+	}
+
+	guint count = slice.length / TS_PACKET_SIZE;
+	guint first = 0;
+
+	for (guint index = 0; index < count; index++)
+	{
+		const guchar* packet = slice.get_data() + index * TS_PACKET_SIZE;
+
+		if (video_pid != NULL_PID && (packet[1] & 0x40) && Mpeg::get_pid(packet) == video_pid &&
+			Mpeg::is_random_access(packet, video_type))
+		{
+			clear_gop();
+			gop_valid = true;
+			first = index;
+		}
+	}
+
+	gop_last_position = slice.get_position() + count - 1;
+
+	if (!gop_valid)
+	{
+		return;
+	}
+
+	if (gop_slices.empty() || gop_slices.back().block != slice.block)
+	{
+		// Too long to be worth sending, wait for the next random access point
+		if (gop_block_count >= GOP_CACHE_MAX_BLOCKS)
+		{
+			clear_gop();
+			gop_valid = false;
+			return;
+		}
+		gop_block_count++;
+	}
+
+	slice.block->reference();
+	gop_slices.push_back(PacketSlice(slice.block, slice.offset + first * TS_PACKET_SIZE, (count - first) * TS_PACKET_SIZE));
+}
+
+// Call with gop_mutex held
+void ChannelStream::clear_gop()
+{
+	for (std::vector<PacketSlice>::iterator i = gop_slices.begin(); i != gop_slices.end(); i++)
+	{
+		i->block->unreference();
+	}
+	gop_slices.clear();
+	gop_block_count = 0;
+}
+
+// The input position of the first packet the frontend thread gave this stream
+gboolean ChannelStream::get_first_position(guint64& position)
+{
+	if (!g_atomic_int_get(&first_position_valid))
+	{
+		return false;
+	}
+
+	position = first_position;
+	return true;
+}
+
+// Copies the cached packets that come before an input position.  Returns false
+// while the writer has not yet got as far as that position.
+gboolean ChannelStream::get_gop(guint64 before, std::vector<guchar>& data)
+{
+	Glib::Mutex::Lock lock(gop_mutex);
+
+	if (gop_last_position < before)
+	{
+		return false;
+	}
+
+	data.clear();
+	for (std::vector<PacketSlice>::iterator i = gop_slices.begin(); i != gop_slices.end(); i++)
+	{
+		guint64 position = i->get_position();
+		if (position >= before)
+		{
+			break;
+		}
+
+		gsize count = MIN(i->length / TS_PACKET_SIZE, before - position);
+		data.insert(data.end(), i->get_data(), i->get_data() + count * TS_PACKET_SIZE);
+	}
+
+	return true;
+}
+
+void ChannelStream::run_writer()
+{
+	g_debug("Channel stream writer running for '%s'", channel.name.c_str());
+
+	// A new client gets the PAT/PMT and the cached GOP before the live packets
+	if (!primer.empty())
+	{
+		try
+		{
+			write_psi();
+			write_data(&primer[0], primer.size());
+		}
+		catch(...)
+		{
+			g_debug("Failed to write");
+		}
+		primer.clear();
+	}
+
+	while (!writer.is_terminated())
+	{
+		PacketSlice* slice = NULL;
+		while ((slice = queue.front()) != NULL)
+		{
+			write_packet(*slice);
+			slice->block->unreference();
+			queue.pop();
+		}
+
+		try
+		{
+			flush_data();
+		}
+		catch(...)
+		{
+			g_debug("Failed to flush");
+		}
+
+		wait_for_data();
+	}
+
+	g_debug("Channel stream writer exited for '%s'", channel.name.c_str());
+}
+
+// Sleeps until commit() queues a slice, or for long enough that flush_data() can
+// send whatever it is holding back.  writer_waiting is set before the queue is
+// checked, so a slice queued after the check always finds it set.
+void ChannelStream::wait_for_data()
+{
+	Glib::Mutex::Lock lock(writer_mutex);
+	g_atomic_int_set(&writer_waiting, true);
+
+	if (queue.front() == NULL && !writer.is_terminated())
+	{
+		Glib::TimeVal deadline;
+		deadline.assign_current_time();
+		deadline.add_milliseconds(CHANNEL_STREAM_FLUSH_INTERVAL);
+		writer_cond.timed_wait(writer_mutex, deadline);
+	}
+
+	g_atomic_int_set(&writer_waiting, false);
+}
+
+// Called by the frontend thread, only takes the lock when the writer is asleep
+void ChannelStream::wake_writer()
+{
+	if (g_atomic_int_get(&writer_waiting))
+	{
+		Glib::Mutex::Lock lock(writer_mutex);
+		writer_cond.signal();
+	}
+}
@@ -24,81 +24,222 @@
 #include "mpeg_stream.h"
 #include "dvb_demuxer.h"
 #include "channel.h"
+#include "thread.h"
+#include "ring_buffer.h"
+#include "packet_block.h"
+#include "recording_writer.h"
+#include "seek_index.h"
+#include "segment_playlist.h"
+#include "timeshift_buffer.h"
+#include "datagram_sender.h"
+#include "stream_sink.h"
 #include "me-tv-types.h"
 #include <giomm.h>
+#include <list>
 #include <netinet/in.h>
+#include <sys/socket.h>
+
+#define CHANNEL_STREAM_QUEUE_SIZE	16384 // slices, must be a power of 2
+#define CHANNEL_STREAM_FLUSH_INTERVAL	100 // milliseconds, for data held back by flush_data()
+
+#define PSI_INTERVAL_PCR			45000 // 90kHz ticks
+#define PSI_INTERVAL_PACKETS		4096
+
+#define GOP_CACHE_MAX_BLOCKS		640 // about 6MB of input
 
 typedef enum
 {
 	CHANNEL_STREAM_TYPE_NONE = -1,
 	CHANNEL_STREAM_TYPE_BROADCAST = 0,
 	CHANNEL_STREAM_TYPE_RECORDING = 1,
-	CHANNEL_STREAM_TYPE_SCHEDULED_RECORDING = 2
+	CHANNEL_STREAM_TYPE_SCHEDULED_RECORDING = 2,
+	CHANNEL_STREAM_TYPE_MULTIPLEX_RECORDING = 3
 } ChannelStreamType;
 
+typedef enum
+{
+	TIMESHIFT_ACTION_PAUSE,
+	TIMESHIFT_ACTION_PLAY,
+	TIMESHIFT_ACTION_SEEK,
+	TIMESHIFT_ACTION_LIVE
+} TimeshiftAction;
+
 class ChannelStream
 {
 private:
-	Glib::StaticRecMutex	mutex;
-	guint					last_insert_time;
+	class Writer : public Thread
+	{
+	private:
+		ChannelStream& channel_stream;
+	public:
+		Writer(ChannelStream& cs) : Thread("Channel Stream Writer"), channel_stream(cs) {}
+		void run() { channel_stream.run_writer(); }
+	};
 
+	Glib::StaticRecMutex	mutex;
+	guchar					pat_packet[TS_PACKET_SIZE];
+	guchar					pmt_packet[TS_PACKET_SIZE];
+	guint					psi_version;
+	guint					psi_pcr_pid;
+	guint64					psi_pcr;
+	gboolean				psi_pcr_valid;
+	guint					psi_packet_count;
+	guint					pat_counter;
+	guint					pmt_counter;
+	RingBuffer<PacketSlice, CHANNEL_STREAM_QUEUE_SIZE>	queue;
+	PacketSlice				pending_slice;
+	volatile gint			overflow_count;
+	Writer					writer;
+	Glib::Mutex				writer_mutex;
+	Glib::Cond				writer_cond;
+	volatile gint			writer_waiting;
+
+	Glib::StaticMutex			gop_mutex;
+	std::vector<PacketSlice>	gop_slices;
+	guint						gop_block_count;
+	guint64						gop_last_position;
+	gboolean				gop_valid;
+	gboolean				gop_reset;
+	volatile gint			first_position_valid;
+	guint64					first_position;
+	std::vector<guchar>		primer;
+
+	void run_writer();
+	void wait_for_data();
+	void wake_writer();
+	void write_packet(const PacketSlice& slice);
+	void write_slice(const PacketSlice& slice);
+	void cache_gop(const PacketSlice& slice);
+	void clear_gop();
+	gboolean is_psi_due(const guchar* packet);
+	void write_psi();
 	virtual void write_data(guchar* buffer, gsize length) = 0;
+	virtual void flush_data() {}
+
+protected:
+	guint					video_pid;
+	guint					video_type;
+
+	void get_psi(std::vector<guchar>& data);
+	void get_start_data(std::vector<guchar>& data);
+
+	void stop();
 	
 public:
 	ChannelStream(ChannelStreamType t, Channel& channel);
 	virtual ~ChannelStream()
 	{
 		g_debug("Destroying channel stream '%s'", channel.name.c_str());
-		clear_demuxers();
+		stop();
 	};
 
 	Mpeg::Stream		stream;
-	Dvb::DemuxerList	demuxers;
 	ChannelStreamType	type;
 	Channel				channel;
 
-	Dvb::Demuxer& add_pes_demuxer(const String& demux_path,
-		guint pid, dmx_pes_type_t pid_type, const gchar* type_text);
-	Dvb::Demuxer& add_section_demuxer(const String& demux_path, guint pid, guint id);
+	void start();
+	void set_layout(guint pmt_pid, const Buffer& section, gboolean ignore_teletext);
+	void write(PacketBlock* block, guint offset);
+	void commit();
+	guint get_overflow_count() { return g_atomic_int_get(&overflow_count); }
 
-	void clear_demuxers();
-	void write(guchar* buffer, gsize length);
+	gboolean get_first_position(guint64& position);
+	gboolean get_gop(guint64 before, std::vector<guchar>& data);
+	void set_primer(std::vector<guchar>& data) { primer.swap(data); }
 
 	virtual String get_description() = 0;
+	virtual String get_statistics() { return ""; }
 };
 
 class BroadcastingChannelStream : public ChannelStream
 {
 private:
+	typedef enum
+	{
+		TIMESHIFT_STATE_LIVE,
+		TIMESHIFT_STATE_PAUSED,
+		TIMESHIFT_STATE_SHIFTED
+	} TimeshiftState;
+
+	// A client of the stream.  Live clients are served by the shared sender, a
+	// paused or time-shifted client has a sender of its own.  A connection client
+	// is given the data through its sink instead, which the stream deletes with the
+	// client if it owns it.
+	class Destination
+	{
+	public:
+		int					client_id;
+		DatagramDestination	target;
+		StreamSink*			sink;
+		gboolean			owns_sink;
+		gboolean			multicast;
+		gboolean			primed;
+		TimeshiftState		timeshift_state;
+		guint64				timeshift_position;
+		DatagramSender*		sender;
+	};
+	typedef std::list<Destination> DestinationList;
+
 	int					sd;
-	struct sockaddr_in	recvaddr;
-	String				address;
 	String				interface;
-	int					port;
-	int					client_id;
-
+	Glib::StaticMutex	destinations_mutex;
+	DestinationList		destinations;
+	DatagramSender		live_sender;
+	TimeshiftBuffer*	timeshift_buffer;
+	guchar				timeshift_data[UDP_DATAGRAM_SIZE * UDP_DATAGRAM_COUNT];
+
+	Destination& get_destination(int client_id);
+	void update_live_destinations();
+	void prime_destinations();
 	void write_data(guchar* buffer, gsize length);
+	void flush_data();
 	String get_description();
-			
+	String get_statistics();
+		
 public:
-	BroadcastingChannelStream(Channel& channel, int client_id, const String& interface, const String& address, int port);
+	BroadcastingChannelStream(Channel& channel, const String& interface);
 	~BroadcastingChannelStream();
 
-	int get_client_id() const { return client_id; }
+	int add_client(int client_id, const String& address, int port, gboolean multicast, gboolean rtp);
+	void add_client(int client_id, StreamSink* sink, gboolean owns_sink = false);
+	void remove_client(int client_id);
+	gboolean has_client(int client_id);
+	gboolean has_clients();
+	void timeshift(int client_id, TimeshiftAction action, guint seconds);
 };
 
+// A recording is written to a single file, or when segment_duration or
+// segment_size is set, to segments that start at video random access points
+// and are listed in a playlist as they are completed.
 class RecordingChannelStream : public ChannelStream
 {
 private:
 	String							mrl;
 	String							description;
-	Glib::RefPtr<Glib::IOChannel>	output_channel;
-
+	RecordingWriter*				recording_writer;
+	RecordingStatistics				statistics;
+	SeekIndex*						seek_index;
+	SegmentPlaylist*				segment_playlist;
+	String							segment_path;
+	guint							segment_index;
+	guint64							segment_start_pts;
+	gboolean						segment_start_pts_valid;
+	gint64							segment_start_time;
+	guint64							last_pts;
+	gboolean						last_pts_valid;
+
+	void open_recording();
+	gboolean start_segment(gboolean at_video);
+	gdouble get_segment_duration();
+	gboolean is_segment_due(gsize pending);
 	void write_data(guchar* buffer, gsize length);
+	void flush_data();
 	String get_description();
+	String get_statistics();
 
 public:
 	RecordingChannelStream(Channel& channel, gboolean scheduled, const String& mrl, const String& description);
+	RecordingChannelStream(ChannelStreamType type, Channel& channel, const String& mrl, const String& description);
 	~RecordingChannelStream();
 };
 
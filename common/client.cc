@@ -25,6 +25,8 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <ifaddrs.h>
+#include <string.h>
 
 using namespace xmlpp;
 
@@ -334,7 +336,9 @@ void Client::remove_scheduled_recording(int scheduled_recording_id)
 	send_request("remove_scheduled_recording", parameters);
 }
 
-Client::BroadcastingStream Client::start_broadcasting(int channel_id, gboolean multicast)
+// A local stream is read from shared memory, only possible when the server is on
+// the same host
+Client::BroadcastingStream Client::start_broadcasting(int channel_id, gboolean multicast, gboolean local)
 {
 	Client::BroadcastingStream result;
 
@@ -349,11 +353,23 @@ Client::BroadcastingStream Client::start_broadcasting(int channel_id, gboolean m
 		ParameterList parameters;
 		parameters.add("channel", channel_id);
 		parameters.add("multicast", multicast ? "true" : "false");
+		if (local)
+		{
+			parameters.add("mode", "local");
+		}
 		Node* node = send_request("start_broadcasting", parameters);
 
 		result.protocol = get_attribute_value(node, "stream/@protocol");
-		result.address = get_attribute_value(node, "stream/@address");
-		result.port = get_int_attribute_value(node, "stream/@port");
+		if (result.protocol == "shm")
+		{
+			result.path = get_attribute_value(node, "stream/@path");
+			result.port = 0;
+		}
+		else
+		{
+			result.address = get_attribute_value(node, "stream/@address");
+			result.port = get_int_attribute_value(node, "stream/@port");
+		}
 
 		broadcasting_channel_id = channel_id;
 	}
@@ -361,6 +377,48 @@ Client::BroadcastingStream Client::start_broadcasting(int channel_id, gboolean m
 	return result;
 }
 
+// The server is local when its address is a loopback address or belongs to one of
+// this host's interfaces
+gboolean Client::is_local() const
+{
+	struct hostent* server = gethostbyname(host.empty() ? "localhost" : host.c_str());
+	if (server == NULL || server->h_addrtype != AF_INET)
+	{
+		return false;
+	}
+
+	struct ifaddrs* interfaces = NULL;
+	if (getifaddrs(&interfaces) < 0)
+	{
+		return false;
+	}
+
+	gboolean result = false;
+	for (char** address = server->h_addr_list; *address != NULL && !result; address++)
+	{
+		struct in_addr server_address;
+		memcpy(&server_address, *address, sizeof(server_address));
+
+		if ((ntohl(server_address.s_addr) >> 24) == IN_LOOPBACKNET)
+		{
+			result = true;
+		}
+
+		for (struct ifaddrs* i = interfaces; i != NULL && !result; i = i->ifa_next)
+		{
+			if (i->ifa_addr != NULL && i->ifa_addr->sa_family == AF_INET &&
+				((struct sockaddr_in*)i->ifa_addr)->sin_addr.s_addr == server_address.s_addr)
+			{
+				result = true;
+			}
+		}
+	}
+
+	freeifaddrs(interfaces);
+
+	return result;
+}
+
 void Client::stop_broadcasting()
 {
 	if (broadcasting_channel_id != -1)
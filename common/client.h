@@ -70,6 +70,7 @@ public:
 		String protocol;
 		String address;
 		int port;
+		String path;
 	};
 
 	class ScheduledRecording
@@ -154,6 +155,7 @@ public:
 
 	int get_client_id() const { return client_id; }
 	int get_broadcasting_channel_id() const { return broadcasting_channel_id; }
+	gboolean is_local() const;
 
 	void terminate();
 
@@ -168,7 +170,7 @@ public:
 	void add_scheduled_recording(int epg_event_id);
 	void remove_scheduled_recording(int scheduled_recording_id);
 
-	BroadcastingStream start_broadcasting(int channel_id, gboolean multicast);
+	BroadcastingStream start_broadcasting(int channel_id, gboolean multicast, gboolean local = false);
 	void stop_broadcasting();
 
 	EpgEventList search_epg(const String& text, gboolean include_description);
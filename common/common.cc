@@ -28,6 +28,7 @@
 
 DeviceManager				device_manager;
 StreamManager				stream_manager;
+DatagramPacer				datagram_pacer;
 Glib::RefPtr<Connection>	data_connection;
 
 sigc::signal<void>			signal_update;
@@ -40,8 +41,16 @@ bool		disable_epg_thread = false;
 String		devices;
 gboolean	ignore_teletext = true;
 String		recording_directory;
+int			recording_sync_interval = 0;
+int			timeshift_size = 0;
+int			segment_duration = 0;
+int			segment_size = 0;
 int			read_timeout = 5000;
 String		broadcast_address;
+String		multicast_address;
+String		multicast_interface;
+int			multicast_ttl = 1;
+bool		pace_output = false;
 String		text_encoding;
 
 void replace_text(String& text, const String& from, const String& to)
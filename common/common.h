@@ -26,6 +26,7 @@
 #include "scheduled_recording_manager.h"
 #include "device_manager.h"
 #include "stream_manager.h"
+#include "datagram_pacer.h"
 
 extern bool							verbose_logging;
 extern bool							disable_epg_thread;
@@ -34,14 +35,23 @@ extern String						devices;
 extern String						preferred_language;
 extern int							read_timeout;
 extern String						recording_directory;
+extern int							recording_sync_interval;
+extern int							timeshift_size;
+extern int							segment_duration;
+extern int							segment_size;
 extern guint						record_extra_before;
 extern guint						record_extra_after;
 extern gboolean						ignore_teletext;
 extern String						broadcast_address;
+extern String						multicast_address;
+extern String						multicast_interface;
+extern int							multicast_ttl;
+extern bool							pace_output;
 extern String						text_encoding;
 
 extern DeviceManager				device_manager;
 extern StreamManager				stream_manager;
+extern DatagramPacer				datagram_pacer;
 extern Glib::RefPtr<Connection>		data_connection;
 
 extern sigc::signal<void>			signal_update;
@@ -20,6 +20,11 @@
 
 #include "crc32.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#endif
+
 guint32 Crc32::crc_table[256] = {
 	0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9, 0x130476dc, 0x17c56b6b,
 	0x1a864db2, 0x1e475005, 0x2608edb8, 0x22c9f00f, 0x2f8ad6d6, 0x2b4bcb61,
@@ -66,6 +71,39 @@ guint32 Crc32::crc_table[256] = {
 	0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
+#define CRC32_POLYNOMIAL		0x04c11db7
+#define CRC32_CHECK_VALUE		0x0376e6e7 // of "123456789"
+
+guint32 Crc32::slice_tables[8][256];
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+// x^n mod P for the folding distances, set by init()
+static guint64 fold_512_high, fold_512_low, fold_128_high, fold_128_low;
+
+static guint64 x_power_mod(guint n)
+{
+	guint32 remainder = 1;
+	while (n-- > 0)
+	{
+		remainder = (remainder << 1) ^ ((remainder & 0x80000000) ? CRC32_POLYNOMIAL : 0);
+	}
+	return remainder;
+}
+
+// Multiplies each 64 bit half of a 128 bit value by x^distance mod P, leaving a
+// value that is congruent to the original shifted up by distance bits
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i fold(__m128i value, __m128i constants)
+{
+	return _mm_xor_si128(_mm_clmulepi64_si128(value, constants, 0x11), _mm_clmulepi64_si128(value, constants, 0x00));
+}
+
+#endif
+
+// Byte-wise until init() has run
+Crc32::CalculateFunction Crc32::calculate_function = Crc32::calculate_bytewise;
+
 void Crc32::init()
 {
 	for (gint i = 0; i < 256; i++ )
@@ -73,34 +111,215 @@ void Crc32::init()
 		guint k = 0;
 		for (guint j = (i << 24) | 0x800000; j != 0x80000000; j <<= 1)
 		{
-			k = (k << 1) ^ (((k ^ j) & 0x80000000) ? 0x04c11db7 : 0);
+			k = (k << 1) ^ (((k ^ j) & 0x80000000) ? CRC32_POLYNOMIAL : 0);
 		}
 		crc_table[i] = k;
+		slice_tables[0][i] = k;
 	}
+
+	// slice_tables[n][i] is the CRC of byte i followed by n zero bytes
+	for (guint n = 1; n < 8; n++)
+	{
+		for (guint i = 0; i < 256; i++)
+		{
+			guint32 previous = slice_tables[n - 1][i];
+			slice_tables[n][i] = (previous << 8) ^ crc_table[previous >> 24];
+		}
+	}
+
+	CalculateFunction function = calculate_sliced;
+	const gchar* name = "slicing-by-8";
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	fold_512_high = x_power_mod(512 + 64);
+	fold_512_low = x_power_mod(512);
+	fold_128_high = x_power_mod(128 + 64);
+	fold_128_low = x_power_mod(128);
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"))
+	{
+		function = calculate_clmul;
+		name = "PCLMULQDQ";
+	}
+#endif
+
+	if (!check(function))
+	{
+		g_message("CRC32 %s implementation failed its self-check, using byte-wise", name);
+		function = calculate_bytewise;
+		name = "byte-wise";
+	}
+
+	calculate_function = function;
+	g_debug("Using %s CRC32", name);
 }
 
-guint32 Crc32::calculate(const guchar* begin, const guchar* end)
-{	
-	guint i_crc = 0xffffffff;
+// Replaces the implementation picked by init(), so that tests can reach each one.
+// Returns false if this CPU cannot run it.
+gboolean Crc32::set_implementation(Implementation implementation)
+{
+	switch (implementation)
+	{
+	case IMPLEMENTATION_BYTEWISE:
+		calculate_function = calculate_bytewise;
+		return true;
+
+	case IMPLEMENTATION_SLICED:
+		calculate_function = calculate_sliced;
+		return true;
+
+	case IMPLEMENTATION_CLMUL:
+#if defined(__x86_64__) && defined(__GNUC__)
+		if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"))
+		{
+			calculate_function = calculate_clmul;
+			return true;
+		}
+#endif
+		break;
+	}
+
+	return false;
+}
+
+// Compares an implementation with the byte-wise one on the standard check
+// value and on every length and alignment up to a few hundred bytes
+gboolean Crc32::check(CalculateFunction function)
+{
+	if (function(0xffffffff, (const guchar*)"123456789", 9) != CRC32_CHECK_VALUE)
+	{
+		return false;
+	}
+
+	guchar data[1024 + 16];
+	guint32 value = 1;
+	for (guint i = 0; i < sizeof(data); i++)
+	{
+		value = value * 1103515245 + 12345;
+		data[i] = value >> 16;
+	}
 
-	while (begin < end)
+	for (gsize alignment = 0; alignment < 16; alignment++)
 	{
-		i_crc = (i_crc<<8) ^ crc_table[ (i_crc>>24) ^ ((unsigned int)*begin) ];
-		begin++;
+		for (gsize length = 0; length <= 300; length++)
+		{
+			if (function(0xffffffff, data + alignment, length) != calculate_bytewise(0xffffffff, data + alignment, length))
+			{
+				return false;
+			}
+		}
+
+		if (function(0xffffffff, data + alignment, 1024) != calculate_bytewise(0xffffffff, data + alignment, 1024))
+		{
+			return false;
+		}
 	}
 
-	return i_crc;
+	return true;
+}
+
+guint32 Crc32::calculate(const guchar* begin, const guchar* end)
+{
+	return calculate_function(0xffffffff, begin, end - begin);
 }
 
 guint32 Crc32::calculate(const guchar* data, gsize length)
 {
-    register guint i;
-    gulong crc = 0xffffffff;
+	return calculate_function(0xffffffff, data, length);
+}
 
-    for (i=0; i<length; i++)
+guint32 Crc32::calculate_bytewise(guint32 crc, const guchar* data, gsize length)
+{
+	while (length-- > 0)
 	{
-		crc = (crc << 8) ^ crc_table[((crc >> 24) ^ *data++) & 0xff];
+		crc = (crc << 8) ^ crc_table[(crc >> 24) ^ *data++];
 	}
-        
-    return crc;
+
+	return crc;
 }
+
+// Eight bytes per step through eight tables, each byte looked up in the table
+// for the number of bytes that follow it in the step
+guint32 Crc32::calculate_sliced(guint32 crc, const guchar* data, gsize length)
+{
+	while (length >= 8)
+	{
+		guint32 word = crc ^ ((data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3]);
+
+		crc =	slice_tables[7][word >> 24] ^
+				slice_tables[6][(word >> 16) & 0xff] ^
+				slice_tables[5][(word >> 8) & 0xff] ^
+				slice_tables[4][word & 0xff] ^
+				slice_tables[3][data[4]] ^
+				slice_tables[2][data[5]] ^
+				slice_tables[1][data[6]] ^
+				slice_tables[0][data[7]];
+
+		data += 8;
+		length -= 8;
+	}
+
+	return calculate_bytewise(crc, data, length);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+// Folds the message 64 bytes at a time in four independent lanes with
+// carry-less multiplies, then reduces the last 16 bytes with the tables.  Data
+// is byte reversed on load so that each register holds the message bits in
+// polynomial order.
+__attribute__((target("pclmul,ssse3")))
+guint32 Crc32::calculate_clmul(guint32 crc, const guchar* data, gsize length)
+{
+	if (length < 64)
+	{
+		return calculate_sliced(crc, data, length);
+	}
+
+	const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i fold_512 = _mm_set_epi64x(fold_512_high, fold_512_low);
+	const __m128i fold_128 = _mm_set_epi64x(fold_128_high, fold_128_low);
+
+	// The initial CRC is the same as XORing it into the first four bytes
+	__m128i lanes[4];
+	for (guint i = 0; i < 4; i++)
+	{
+		lanes[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)), reverse);
+	}
+	lanes[0] = _mm_xor_si128(lanes[0], _mm_set_epi32(crc, 0, 0, 0));
+	data += 64;
+	length -= 64;
+
+	while (length >= 64)
+	{
+		for (guint i = 0; i < 4; i++)
+		{
+			__m128i block = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)), reverse);
+			lanes[i] = _mm_xor_si128(fold(lanes[i], fold_512), block);
+		}
+		data += 64;
+		length -= 64;
+	}
+
+	__m128i value = lanes[0];
+	for (guint i = 1; i < 4; i++)
+	{
+		value = _mm_xor_si128(fold(value, fold_128), lanes[i]);
+	}
+
+	while (length >= 16)
+	{
+		__m128i block = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), reverse);
+		value = _mm_xor_si128(fold(value, fold_128), block);
+		data += 16;
+		length -= 16;
+	}
+
+	guchar remainder[16];
+	_mm_storeu_si128((__m128i*)remainder, _mm_shuffle_epi8(value, reverse));
+
+	return calculate_sliced(calculate_sliced(0, remainder, 16), data, length);
+}
+
+#endif
@@ -23,12 +23,36 @@
 
 #include <glib.h>
 
+// CRC-32/MPEG-2 as used by PSI sections.  init() builds the slicing tables and
+// picks the fastest implementation this CPU can run, carry-less multiply
+// folding on x86-64 with PCLMULQDQ or slicing-by-8 elsewhere, after checking it
+// against the byte-wise reference.
 class Crc32
 {
 private:
-	static guint crc_table[256];
+	typedef guint32 (*CalculateFunction)(guint32 crc, const guchar* data, gsize length);
+
+	static guint32 crc_table[256];
+	static guint32 slice_tables[8][256];
+	static CalculateFunction calculate_function;
+
+	static guint32 calculate_bytewise(guint32 crc, const guchar* data, gsize length);
+	static guint32 calculate_sliced(guint32 crc, const guchar* data, gsize length);
+#if defined(__x86_64__) && defined(__GNUC__)
+	static guint32 calculate_clmul(guint32 crc, const guchar* data, gsize length);
+#endif
+	static gboolean check(CalculateFunction function);
+
 public:
+	enum Implementation
+	{
+		IMPLEMENTATION_BYTEWISE,
+		IMPLEMENTATION_SLICED,
+		IMPLEMENTATION_CLMUL
+	};
+
 	static void init();
+	static gboolean set_implementation(Implementation implementation);
 	static guint32 calculate(const guchar* begin, const guchar* end);
 	static guint32 calculate(const guchar* data, gsize length);
 };
@@ -24,7 +24,12 @@
 #include "common.h"
 #include <giomm.h>
 
-#define CURRENT_DATABASE_VERSION	9
+#define CURRENT_DATABASE_VERSION	10
+
+#define PMT_CACHE_SCHEMA \
+	"CREATE TABLE pmt_cache (frontend_type INTEGER NOT NULL, frequency INTEGER NOT NULL, polarisation INTEGER NOT NULL, satellite_number INTEGER NOT NULL, " \
+	"service_id INTEGER NOT NULL, pmt_pid INTEGER NOT NULL, section CHAR(2048) NOT NULL, " \
+	"PRIMARY KEY (frontend_type, frequency, polarisation, satellite_number, service_id));"
 
 Glib::RefPtr<Connection> Data::create_connection()
 {
@@ -57,6 +62,7 @@ Glib::RefPtr<Connection> Data::create_connection()
 		    "polarisation INTEGER, record_extra_before INTEGER, record_extra_after INTEGER, UNIQUE (name));");
 		connection->statement_execute("CREATE TABLE configuration (id INTEGER PRIMARY KEY AUTOINCREMENT, name CHAR(200) NOT NULL, value CHAR(1024) NOT NULL, UNIQUE (name));");
 		connection->statement_execute("CREATE TABLE epg_event (id INTEGER PRIMARY KEY AUTOINCREMENT, channel_id INTEGER NOT NULL, version_number INTEGER NOT NULL, event_id INTEGER NOT NULL, start_time INTEGER NOT NULL, duration INTEGER NOT NULL, UNIQUE (channel_id, event_id));");
+		connection->statement_execute(PMT_CACHE_SCHEMA);
 		connection->statement_execute("CREATE TABLE epg_event_text (id INTEGER PRIMARY KEY AUTOINCREMENT, epg_event_id INTEGER NOT NULL, language CHAR(3) NOT NULL, title CHAR(200) NOT NULL, subtitle CHAR(200) NOT NULL, description CHAR(1000) NOT NULL, UNIQUE (epg_event_id, language));");
 		connection->statement_execute("CREATE TABLE scheduled_recording (id INTEGER PRIMARY KEY AUTOINCREMENT, description CHAR(200) NOT NULL, recurring_type INTEGER NOT NULL, action_after INTEGER NOT NULL, channel_id INTEGER NOT NULL, start_time INTEGER NOT NULL, duration INTEGER NOT NULL, device CHAR(200) NOT NULL);");
 		connection->statement_execute("CREATE TABLE version (value INTEGER NOT NULL);");
@@ -73,6 +79,14 @@ Glib::RefPtr<Connection> Data::create_connection()
 	g_debug("Required database version: %d", CURRENT_DATABASE_VERSION);
 	g_debug("Actual database version: %d", version_value);	
 
+	if (version_value == 9)
+	{
+		g_debug("Upgrading database from version 9 to 10");
+		connection->statement_execute(PMT_CACHE_SCHEMA);
+		connection->statement_execute("update version set value = 10;");
+		version_value = 10;
+	}
+
 	if (version_value != CURRENT_DATABASE_VERSION)
 	{
 		throw Exception("Me TV database version does not match");
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "datagram_pacer.h"
+#include <string.h>
+
+DatagramPacer::DatagramPacer() : Thread("Datagram Pacer")
+{
+	g_static_mutex_init(mutex.gobj());
+	g_static_mutex_init(send_mutex.gobj());
+	current_tick = g_get_monotonic_time() / PACER_TICK;
+}
+
+DatagramPacer::~DatagramPacer()
+{
+	join(true);
+
+	for (guint i = 0; i < PACER_WHEEL_SLOTS; i++)
+	{
+		for (BatchList::iterator j = wheel[i].begin(); j != wheel[i].end(); j++)
+		{
+			delete *j;
+		}
+	}
+
+	for (std::vector<Batch*>::iterator i = free_batches.begin(); i != free_batches.end(); i++)
+	{
+		delete *i;
+	}
+}
+
+// Datagrams for the same socket and destinations that fall into the same tick
+// are sent together
+void DatagramPacer::schedule(int sd, const DatagramDestinationList& destinations, const guchar* rtp_header,
+	const guchar* datagram, gsize length, gint64 release_time)
+{
+	if (destinations.empty())
+	{
+		return;
+	}
+
+	Glib::Mutex::Lock lock(mutex);
+
+	gint64 tick = release_time / PACER_TICK;
+	tick = CLAMP(tick, current_tick, current_tick + PACER_WHEEL_SLOTS - 1);
+	BatchList& slot = wheel[tick % PACER_WHEEL_SLOTS];
+
+	Batch* batch = slot.empty() ? NULL : slot.back();
+	if (batch == NULL || batch->sd != sd || batch->count == UDP_DATAGRAM_COUNT || !(batch->destinations == destinations))
+	{
+		if (free_batches.empty())
+		{
+			batch = new Batch();
+		}
+		else
+		{
+			batch = free_batches.back();
+			free_batches.pop_back();
+		}
+
+		batch->sd = sd;
+		batch->destinations = destinations;
+		batch->count = 0;
+		slot.push_back(batch);
+	}
+
+	memcpy(batch->rtp_headers[batch->count], rtp_header, RTP_HEADER_SIZE);
+	memcpy(batch->datagrams[batch->count], datagram, length);
+	batch->lengths[batch->count] = length;
+	batch->count++;
+}
+
+// Drops everything scheduled for a socket, and waits for a send that is in
+// progress, so the socket can be closed afterwards
+void DatagramPacer::cancel(int sd)
+{
+	Glib::Mutex::Lock send_lock(send_mutex);
+	Glib::Mutex::Lock lock(mutex);
+
+	for (guint i = 0; i < PACER_WHEEL_SLOTS; i++)
+	{
+		BatchList::iterator j = wheel[i].begin();
+		while (j != wheel[i].end())
+		{
+			if ((*j)->sd == sd)
+			{
+				free_batches.push_back(*j);
+				j = wheel[i].erase(j);
+			}
+			else
+			{
+				j++;
+			}
+		}
+	}
+}
+
+void DatagramPacer::run()
+{
+	BatchList due;
+
+	g_debug("Datagram pacer running");
+
+	while (!is_terminated())
+	{
+		gint64 now = g_get_monotonic_time();
+		gint64 now_tick = now / PACER_TICK;
+
+		{
+			Glib::Mutex::Lock send_lock(send_mutex);
+
+			{
+				Glib::Mutex::Lock lock(mutex);
+
+				// After a stall everything still in the wheel is overdue
+				if (now_tick - current_tick >= PACER_WHEEL_SLOTS)
+				{
+					current_tick = now_tick - PACER_WHEEL_SLOTS + 1;
+				}
+
+				while (current_tick <= now_tick)
+				{
+					BatchList& slot = wheel[current_tick % PACER_WHEEL_SLOTS];
+					due.splice(due.end(), slot);
+					current_tick++;
+				}
+			}
+
+			for (BatchList::iterator i = due.begin(); i != due.end(); i++)
+			{
+				Batch& batch = **i;
+				int error = DatagramSender::send(batch.sd, batch.destinations,
+					batch.datagrams, batch.lengths, batch.rtp_headers, batch.count);
+				if (error != 0)
+				{
+					g_debug("Failed to send paced datagrams: %s", strerror(error));
+				}
+			}
+		}
+
+		if (!due.empty())
+		{
+			Glib::Mutex::Lock lock(mutex);
+			free_batches.insert(free_batches.end(), due.begin(), due.end());
+			due.clear();
+		}
+
+		usleep(PACER_TICK - g_get_monotonic_time() % PACER_TICK);
+	}
+
+	g_debug("Datagram pacer exited");
+}
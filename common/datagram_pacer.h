@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __DATAGRAM_PACER_H__
+#define __DATAGRAM_PACER_H__
+
+#include "thread.h"
+#include "datagram_sender.h"
+#include <list>
+
+#define PACER_TICK			1000 // microseconds
+#define PACER_WHEEL_SLOTS	2048 // ticks, the furthest a datagram can be scheduled ahead
+
+// Releases datagrams at scheduled times for all paced senders.  Datagrams are put
+// into the slot of a timer wheel for their release tick, a single thread sends
+// each slot when its tick comes round.
+class DatagramPacer : public Thread
+{
+private:
+	class Batch
+	{
+	public:
+		int							sd;
+		DatagramDestinationList		destinations;
+		guchar						datagrams[UDP_DATAGRAM_COUNT][UDP_DATAGRAM_SIZE];
+		gsize						lengths[UDP_DATAGRAM_COUNT];
+		guchar						rtp_headers[UDP_DATAGRAM_COUNT][RTP_HEADER_SIZE];
+		guint						count;
+	};
+	typedef std::list<Batch*> BatchList;
+
+	Glib::StaticMutex	mutex;
+	Glib::StaticMutex	send_mutex;
+	BatchList			wheel[PACER_WHEEL_SLOTS];
+	gint64				current_tick;
+	std::vector<Batch*>	free_batches;
+
+public:
+	DatagramPacer();
+	~DatagramPacer();
+
+	void run();
+	void schedule(int sd, const DatagramDestinationList& destinations, const guchar* rtp_header,
+		const guchar* datagram, gsize length, gint64 release_time);
+	void cancel(int sd);
+};
+
+#endif
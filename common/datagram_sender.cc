@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "datagram_sender.h"
+#include "exception.h"
+#include "common.h"
+#include <string.h>
+
+DatagramSender::DatagramSender(int s, gboolean p) : sd(s), paced(p)
+{
+	datagram_count = 0;
+	datagram_length = 0;
+	datagram_deadline = 0;
+	rtp_sequence = g_random_int();
+	rtp_ssrc = g_random_int();
+	send_error = 0;
+
+	pcr_pid = NULL_PID;
+	last_pcr = 0;
+	last_pcr_time = 0;
+	last_release_time = 0;
+	pcr_interval_bytes = 0;
+	bytes_since_pcr = 0;
+	pcr_interval_time = 0;
+}
+
+void DatagramSender::set_destinations(const DatagramDestinationList& d)
+{
+	destinations = d;
+}
+
+void DatagramSender::write(const guchar* buffer, gsize length)
+{
+	if (paced)
+	{
+		write_paced(buffer, length);
+		return;
+	}
+
+	while (length > 0)
+	{
+		if (datagram_length == 0)
+		{
+			datagram_deadline = g_get_monotonic_time() + UDP_FLUSH_TIMEOUT;
+		}
+
+		gsize size = MIN(length, UDP_DATAGRAM_SIZE - datagram_length);
+		memcpy(datagrams[datagram_count] + datagram_length, buffer, size);
+		datagram_length += size;
+		buffer += size;
+		length -= size;
+
+		if (datagram_length == UDP_DATAGRAM_SIZE)
+		{
+			complete_datagram();
+			if (datagram_count == UDP_DATAGRAM_COUNT)
+			{
+				send();
+			}
+		}
+	}
+
+	throw_send_error();
+}
+
+// Sends all complete datagrams, a partial datagram is only sent once it is
+// older than UDP_FLUSH_TIMEOUT so that latency stays bounded on quiet streams
+void DatagramSender::flush(gboolean force)
+{
+	if (datagram_length > 0 && (force || g_get_monotonic_time() >= datagram_deadline))
+	{
+		complete_datagram();
+	}
+
+	if (datagram_count > 0)
+	{
+		send();
+	}
+
+	throw_send_error();
+}
+
+// Stamps the RTP header of the datagram being filled.  A paced datagram goes to
+// the pacer straight away, others wait for the next send().
+void DatagramSender::complete_datagram()
+{
+	gint64 release_time = paced ? get_release_time() : g_get_monotonic_time();
+	guint32 timestamp = release_time * 9 / 100;
+	guchar* header = rtp_headers[datagram_count];
+
+	header[0] = 0x80;
+	header[1] = RTP_PAYLOAD_TYPE_MP2T;
+	header[2] = rtp_sequence >> 8;
+	header[3] = rtp_sequence & 0xff;
+	header[4] = timestamp >> 24;
+	header[5] = (timestamp >> 16) & 0xff;
+	header[6] = (timestamp >> 8) & 0xff;
+	header[7] = timestamp & 0xff;
+	header[8] = rtp_ssrc >> 24;
+	header[9] = (rtp_ssrc >> 16) & 0xff;
+	header[10] = (rtp_ssrc >> 8) & 0xff;
+	header[11] = rtp_ssrc & 0xff;
+	rtp_sequence++;
+
+	if (paced)
+	{
+		datagram_pacer.schedule(sd, destinations, header, datagrams[datagram_count], datagram_length, release_time);
+	}
+	else
+	{
+		lengths[datagram_count++] = datagram_length;
+	}
+	datagram_length = 0;
+}
+
+// A failing destination does not stop the others from being sent to, the first
+// error is kept for throw_send_error()
+void DatagramSender::send()
+{
+	guint count = datagram_count;
+
+	datagram_count = 0;
+
+	int error = send(sd, destinations, datagrams, lengths, rtp_headers, count);
+
+	// Move a pending partial datagram to the front of the queue
+	if (datagram_length > 0)
+	{
+		memcpy(datagrams[0], datagrams[count], datagram_length);
+	}
+
+	if (error != 0 && send_error == 0)
+	{
+		send_error = error;
+	}
+}
+
+void DatagramSender::throw_send_error()
+{
+	if (send_error != 0)
+	{
+		errno = send_error;
+		send_error = 0;
+		throw SystemException("Failed to send data");
+	}
+}
+
+// Sends count datagrams to each destination, RTP destinations get the header in
+// front of each datagram.  Returns the first error, or 0.
+int DatagramSender::send(int sd, const DatagramDestinationList& destinations, guchar datagrams[][UDP_DATAGRAM_SIZE],
+	const gsize* lengths, guchar rtp_headers[][RTP_HEADER_SIZE], guint count)
+{
+	struct iovec iovecs[UDP_DATAGRAM_COUNT][2];
+	struct mmsghdr messages[UDP_DATAGRAM_COUNT];
+	int error = 0;
+
+	memset(messages, 0, sizeof(messages));
+	for (DatagramDestinationList::const_iterator i = destinations.begin(); i != destinations.end(); i++)
+	{
+		const DatagramDestination& destination = *i;
+
+		for (guint j = 0; j < count; j++)
+		{
+			struct iovec* iovec = iovecs[j];
+			if (destination.rtp)
+			{
+				iovec->iov_base = rtp_headers[j];
+				iovec->iov_len = RTP_HEADER_SIZE;
+				iovec++;
+			}
+			iovec->iov_base = datagrams[j];
+			iovec->iov_len = lengths[j];
+
+			messages[j].msg_hdr.msg_iov = iovecs[j];
+			messages[j].msg_hdr.msg_iovlen = destination.rtp ? 2 : 1;
+			messages[j].msg_hdr.msg_name = (void*)&destination.address;
+			messages[j].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		}
+
+		guint sent = 0;
+		while (sent < count)
+		{
+			int result = ::sendmmsg(sd, messages + sent, count - sent, 0);
+			if (result < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				if (error == 0)
+				{
+					error = errno;
+				}
+				break;
+			}
+			sent += result;
+		}
+	}
+
+	return error;
+}
+
+// The first PCR sets the release time of its packet to PACING_DELAY from now and
+// later PCRs follow on from it.  The clock starts again after a discontinuity or
+// when the release times have drifted too far from the system clock.
+void DatagramSender::update_pcr_clock(const guchar* packet)
+{
+	guint64 pcr = 0;
+	guint pid = Mpeg::get_pid(packet);
+
+	if ((pcr_pid != NULL_PID && pid != pcr_pid) || !Mpeg::get_pcr(packet, pcr))
+	{
+		return;
+	}
+
+	gint64 now = g_get_monotonic_time();
+
+	if (pcr_pid != NULL_PID)
+	{
+		gint64 elapsed = (((pcr - last_pcr) & G_GUINT64_CONSTANT(0x1FFFFFFFF)) * 100) / 9;
+		gint64 release_time = last_pcr_time + elapsed;
+
+		if (elapsed > 0 && elapsed < PACING_MAX_PCR_GAP &&
+			release_time > now - PACING_DELAY && release_time < now + 2 * PACING_DELAY)
+		{
+			pcr_interval_bytes = bytes_since_pcr;
+			pcr_interval_time = elapsed;
+			last_pcr_time = release_time;
+			last_pcr = pcr;
+			bytes_since_pcr = 0;
+			return;
+		}
+
+		g_debug("Restarting PCR pacing clock");
+	}
+
+	pcr_pid = pid;
+	pcr_interval_bytes = 0;
+	pcr_interval_time = 0;
+	last_pcr_time = now + PACING_DELAY;
+	last_pcr = pcr;
+	bytes_since_pcr = 0;
+}
+
+// Datagrams between two PCRs are spread out at the rate of the last PCR interval
+gint64 DatagramSender::get_release_time()
+{
+	gint64 release_time = g_get_monotonic_time();
+
+	if (pcr_pid != NULL_PID)
+	{
+		release_time = last_pcr_time;
+		if (pcr_interval_bytes > 0)
+		{
+			release_time += (gint64)bytes_since_pcr * pcr_interval_time / pcr_interval_bytes;
+		}
+	}
+
+	// Never reorder datagrams
+	last_release_time = MAX(last_release_time, release_time);
+	return last_release_time;
+}
+
+void DatagramSender::write_paced(const guchar* buffer, gsize length)
+{
+	for (gsize offset = 0; offset < length; offset += TS_PACKET_SIZE)
+	{
+		const guchar* packet = buffer + offset;
+
+		update_pcr_clock(packet);
+
+		if (datagram_length == 0)
+		{
+			datagram_deadline = g_get_monotonic_time() + UDP_FLUSH_TIMEOUT;
+		}
+
+		memcpy(datagrams[0] + datagram_length, packet, TS_PACKET_SIZE);
+		datagram_length += TS_PACKET_SIZE;
+		bytes_since_pcr += TS_PACKET_SIZE;
+
+		if (datagram_length == UDP_DATAGRAM_SIZE)
+		{
+			complete_datagram();
+		}
+	}
+}
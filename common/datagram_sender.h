@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __DATAGRAM_SENDER_H__
+#define __DATAGRAM_SENDER_H__
+
+#include "mpeg_stream.h"
+#include "me-tv-types.h"
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define UDP_PACKETS_PER_DATAGRAM	7
+#define UDP_DATAGRAM_SIZE			(TS_PACKET_SIZE * UDP_PACKETS_PER_DATAGRAM)
+#define UDP_DATAGRAM_COUNT			16
+#define UDP_FLUSH_TIMEOUT			20000 // microseconds
+
+#define RTP_HEADER_SIZE				12
+#define RTP_PAYLOAD_TYPE_MP2T		33
+
+#define PACING_DELAY				200000 // microseconds
+#define PACING_MAX_PCR_GAP			1000000 // microseconds
+
+// Where datagrams go, and whether they go as raw TS or as RTP/MP2T
+class DatagramDestination
+{
+public:
+	struct sockaddr_in	address;
+	gboolean			rtp;
+
+	bool operator==(const DatagramDestination& destination) const
+	{
+		return address.sin_addr.s_addr == destination.address.sin_addr.s_addr &&
+			address.sin_port == destination.address.sin_port && rtp == destination.rtp;
+	}
+};
+typedef std::vector<DatagramDestination> DatagramDestinationList;
+
+// Packs a byte stream into 7 packet (1316 byte) datagrams and sends each batch of
+// datagrams to every destination with sendmmsg(), so the data is only copied once
+// no matter how many destinations there are.  A paced sender instead gives each
+// datagram a release time from the stream's PCR and hands it to the datagram pacer.
+// A send error is thrown by write() or flush() once all of the data has been taken.
+class DatagramSender
+{
+private:
+	int							sd;
+	DatagramDestinationList		destinations;
+	guchar						datagrams[UDP_DATAGRAM_COUNT][UDP_DATAGRAM_SIZE];
+	gsize						lengths[UDP_DATAGRAM_COUNT];
+	guchar						rtp_headers[UDP_DATAGRAM_COUNT][RTP_HEADER_SIZE];
+	guint						datagram_count;
+	gsize						datagram_length;
+	gint64						datagram_deadline;
+	guint16						rtp_sequence;
+	guint32						rtp_ssrc;
+	int							send_error;
+
+	gboolean					paced;
+	guint						pcr_pid;
+	guint64						last_pcr;
+	gint64						last_pcr_time;
+	gint64						last_release_time;
+	gsize						pcr_interval_bytes;
+	gsize						bytes_since_pcr;
+	gint64						pcr_interval_time;
+
+	void complete_datagram();
+	void send();
+	void throw_send_error();
+	void write_paced(const guchar* buffer, gsize length);
+	void update_pcr_clock(const guchar* packet);
+	gint64 get_release_time();
+
+public:
+	DatagramSender(int sd, gboolean paced = false);
+
+	void set_destinations(const DatagramDestinationList& destinations);
+	void write(const guchar* buffer, gsize length);
+	void flush(gboolean force = false);
+
+	static int send(int sd, const DatagramDestinationList& destinations, guchar datagrams[][UDP_DATAGRAM_SIZE],
+		const gsize* lengths, guchar rtp_headers[][RTP_HEADER_SIZE], guint count);
+};
+
+#endif
@@ -52,7 +52,7 @@ Demuxer::~Demuxer()
 	}
 }
 
-void Demuxer::set_pes_filter(uint16_t pid, dmx_pes_type_t pestype)
+void Demuxer::set_pes_filter(uint16_t pid, dmx_pes_type_t pestype, dmx_output_t output)
 {
 	struct dmx_pes_filter_params parameters;
 	
@@ -60,7 +60,7 @@ void Demuxer::set_pes_filter(uint16_t pid, dmx_pes_type_t pestype)
 
 	parameters.pid     = pid;
 	parameters.input   = DMX_IN_FRONTEND;
-	parameters.output  = DMX_OUT_TS_TAP;
+	parameters.output  = output;
 	parameters.pes_type = pestype;
 	parameters.flags   = DMX_IMMEDIATE_START | DMX_CHECK_CRC;
 
@@ -73,6 +73,28 @@ void Demuxer::set_pes_filter(uint16_t pid, dmx_pes_type_t pestype)
 	filter_type = FILTER_TYPE_PES;
 }
 
+// Multiple PIDs on one filter are only supported by the kernel for DMX_OUT_TSDEMUX_TAP,
+// so the packets have to be read from this demuxer rather than the DVR device
+void Demuxer::add_pid(uint16_t pid)
+{
+	if (filter_type == FILTER_TYPE_NONE)
+	{
+		set_pes_filter(pid, DMX_PES_OTHER, DMX_OUT_TSDEMUX_TAP);
+	}
+	else if (ioctl(fd, DMX_ADD_PID, &pid) < 0)
+	{
+		throw SystemException(_("Failed to add PID to demuxer"));
+	}
+}
+
+void Demuxer::remove_pid(uint16_t pid)
+{
+	if (ioctl(fd, DMX_REMOVE_PID, &pid) < 0)
+	{
+		throw SystemException(_("Failed to remove PID from demuxer"));
+	}
+}
+
 void Demuxer::set_filter(ushort pid, ushort table_id, ushort mask)
 {
 	struct dmx_sct_filter_params parameters;
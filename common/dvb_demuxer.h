@@ -28,6 +28,8 @@
 #include <linux/dvb/dmx.h>
 #include "me-tv-types.h"
 
+#define ALL_PIDS	0x2000 // Demuxer PID for the whole transport stream
+
 extern int read_timeout;
 
 namespace Dvb
@@ -47,7 +49,9 @@ namespace Dvb
 		int pid;
 		FilterType filter_type;
 
-		void set_pes_filter(uint16_t pid, dmx_pes_type_t pestype);		
+		void set_pes_filter(uint16_t pid, dmx_pes_type_t pestype, dmx_output_t output = DMX_OUT_TS_TAP);
+		void add_pid(uint16_t pid);
+		void remove_pid(uint16_t pid);
 		void set_filter(ushort pid, ushort table_id, ushort mask = 0xFF);
 		void set_buffer_size(unsigned int buffer_size);
 		gint read(unsigned char* buffer, size_t length, gint timeout = read_timeout);
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "dvb_section_filter.h"
+#include "dvb_si.h"
+#include <string.h>
+
+using namespace Dvb;
+
+SectionFilter::SectionFilter()
+{
+	memset(pid_filter_counts, 0, sizeof(pid_filter_counts));
+	next_id = 1;
+}
+
+// Registers a handler for the sections on a PID, or on every PID pushed with
+// SECTION_FILTER_ANY_PID, whose table ID matches table_id under mask.  Returns
+// an ID for remove().
+guint SectionFilter::add(guint pid, guint table_id, guint mask, gboolean deduplicate, const SectionHandler& handler)
+{
+	Filter filter;
+	filter.id = next_id++;
+	filter.pid = MIN(pid, (guint)SECTION_FILTER_ANY_PID);
+	filter.table_id = table_id & mask;
+	filter.mask = mask;
+	filter.deduplicate = deduplicate;
+	filter.handler = handler;
+	filters.push_back(filter);
+
+	pid_filter_counts[filter.pid]++;
+
+	return filter.id;
+}
+
+void SectionFilter::remove(guint id)
+{
+	for (FilterList::iterator i = filters.begin(); i != filters.end(); i++)
+	{
+		if (i->id == id)
+		{
+			pid_filter_counts[i->pid]--;
+			filters.erase(i);
+			return;
+		}
+	}
+}
+
+// Drops partly assembled sections and forgets the versions that have been
+// delivered, for a new transponder
+void SectionFilter::reset()
+{
+	assemblers.clear();
+	for (FilterList::iterator i = filters.begin(); i != filters.end(); i++)
+	{
+		i->versions.clear();
+	}
+}
+
+void SectionFilter::push(const guchar* packet)
+{
+	guint pid = ((packet[1] & 0x1f) << 8) + packet[2];
+	if (!is_wanted(pid))
+	{
+		return;
+	}
+
+	Assembler& assembler = assemblers[pid];
+
+	if (packet[0] != 0x47 || (packet[1] & 0x80) != 0)
+	{
+		assembler.assembling = false;
+		return;
+	}
+
+	guint adaptation_field_control = (packet[3] >> 4) & 0x03;
+	guint continuity_counter = packet[3] & 0x0f;
+
+	if ((adaptation_field_control & 0x01) == 0)
+	{
+		return;
+	}
+
+	if (assembler.assembling && continuity_counter != ((assembler.continuity_counter + 1) & 0x0f))
+	{
+		if (continuity_counter == assembler.continuity_counter)
+		{
+			return; // Duplicate packet
+		}
+		assembler.assembling = false;
+	}
+	assembler.continuity_counter = continuity_counter;
+
+	const guchar* payload = packet + 4;
+	if (adaptation_field_control & 0x02)
+	{
+		payload += packet[4] + 1;
+	}
+
+	const guchar* end = packet + TS_PACKET_SIZE;
+	if (payload >= end)
+	{
+		return;
+	}
+
+	if (packet[1] & 0x40)
+	{
+		guint pointer_field = payload[0];
+		payload++;
+
+		if (payload + pointer_field > end)
+		{
+			assembler.assembling = false;
+			return;
+		}
+
+		if (assembler.assembling)
+		{
+			append(pid, assembler, payload, pointer_field, false);
+			assembler.assembling = false;
+		}
+
+		payload += pointer_field;
+		append(pid, assembler, payload, end - payload, true);
+	}
+	else if (assembler.assembling)
+	{
+		append(pid, assembler, payload, end - payload, false);
+	}
+}
+
+// Collects the three byte header first, then the rest of the section straight
+// into the section buffer, which is only reallocated when the length changes
+void SectionFilter::append(guint pid, Assembler& assembler, const guchar* data, gsize length, gboolean allow_start)
+{
+	while (length > 0)
+	{
+		if (!assembler.assembling)
+		{
+			if (!allow_start || data[0] == 0xFF)
+			{
+				return; // Stuffing
+			}
+
+			assembler.assembling = true;
+			assembler.received = 0;
+		}
+
+		if (assembler.received < 3)
+		{
+			assembler.header[assembler.received++] = *data++;
+			length--;
+
+			if (assembler.received == 3)
+			{
+				gsize total = 3 + (((assembler.header[1] & 0x0f) << 8) | assembler.header[2]);
+				if (total > SECTION_FILTER_MAX_LENGTH)
+				{
+					assembler.assembling = false;
+					return;
+				}
+
+				assembler.section.set_length(total);
+				memcpy(assembler.section.get_buffer(), assembler.header, 3);
+			}
+			continue;
+		}
+
+		gsize total = assembler.section.get_length();
+		gsize count = MIN(length, total - assembler.received);
+		memcpy(assembler.section.get_buffer() + assembler.received, data, count);
+		assembler.received += count;
+		data += count;
+		length -= count;
+
+		if (assembler.received == total)
+		{
+			assembler.assembling = false;
+			dispatch(pid, assembler.section);
+		}
+	}
+}
+
+void SectionFilter::dispatch(guint pid, const Buffer& section)
+{
+	gsize length = section.get_length();
+	guint table_id = section[0];
+	gboolean syntax = (section[1] & 0x80) != 0;
+
+	// Sections with the long syntax, and the TOT, end with a CRC
+	if ((syntax || table_id == TOT_ID) && (length < 7 || section.crc32() != 0))
+	{
+		return;
+	}
+
+	guint64 key = 0;
+	guint version = 0;
+	if (syntax)
+	{
+		if (length < 8 || (section[5] & 0x01) == 0)
+		{
+			return; // Not yet current
+		}
+
+		// PID, table ID, table ID extension and section number
+		key = ((guint64)pid << 40) | ((guint64)table_id << 32) | (section[3] << 16) | (section[4] << 8) | section[6];
+		version = (section[5] >> 1) & 0x1f;
+	}
+
+	for (FilterList::iterator i = filters.begin(); i != filters.end(); i++)
+	{
+		Filter& filter = *i;
+
+		if ((filter.pid != pid && filter.pid != SECTION_FILTER_ANY_PID) || (table_id & filter.mask) != filter.table_id)
+		{
+			continue;
+		}
+
+		if (syntax && filter.deduplicate)
+		{
+			std::map<guint64, guint>::iterator seen = filter.versions.find(key);
+			if (seen != filter.versions.end() && seen->second == version)
+			{
+				continue;
+			}
+			filter.versions[key] = version;
+		}
+
+		filter.handler(pid, section);
+	}
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __DVB_SECTION_FILTER_H__
+#define __DVB_SECTION_FILTER_H__
+
+#include "buffer.h"
+#include "me-tv-types.h"
+#include <map>
+#include <list>
+
+#define SECTION_FILTER_MAX_LENGTH	4096
+#define SECTION_FILTER_ANY_PID		0x2000
+
+namespace Dvb
+{
+	// Reassembles PSI/SI sections in user space from transport stream packets,
+	// for any number of PIDs and table ID masks at once, instead of opening a
+	// kernel section filter for each table.  Sections that fail their CRC, or
+	// that are not yet current, are dropped.  A filter can also ask for sections
+	// to be dropped when the same version of them has already been delivered.
+	class SectionFilter
+	{
+	public:
+		typedef sigc::slot<void, guint, const Buffer&> SectionHandler;
+
+	private:
+		class Filter
+		{
+		public:
+			guint						id;
+			guint						pid;
+			guint						table_id;
+			guint						mask;
+			gboolean					deduplicate;
+			std::map<guint64, guint>	versions;
+			SectionHandler				handler;
+		};
+		typedef std::list<Filter> FilterList;
+
+		class Assembler
+		{
+		public:
+			Assembler() : assembling(false), continuity_counter(0), received(0) {}
+
+			gboolean	assembling;
+			guint		continuity_counter;
+			guchar		header[3];
+			gsize		received;
+			Buffer		section;
+		};
+
+		FilterList					filters;
+		std::map<guint, Assembler>	assemblers;
+		guint						pid_filter_counts[SECTION_FILTER_ANY_PID + 1];
+		guint						next_id;
+
+		void append(guint pid, Assembler& assembler, const guchar* data, gsize length, gboolean allow_start);
+		void dispatch(guint pid, const Buffer& section);
+
+	public:
+		SectionFilter();
+
+		guint add(guint pid, guint table_id, guint mask, gboolean deduplicate, const SectionHandler& handler);
+		void remove(guint id);
+		void reset();
+
+		gboolean is_wanted(guint pid) const
+		{
+			return pid_filter_counts[pid] > 0 || pid_filter_counts[SECTION_FILTER_ANY_PID] > 0;
+		}
+
+		void push(const guchar* packet);
+	};
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "dvb_section_reader.h"
+#include "exception.h"
+#include <string.h>
+#include <unistd.h>
+
+using namespace Dvb;
+
+SectionReader::SectionReader(const String& demux_path) : demuxer(demux_path)
+{
+	next_id = 1;
+	demuxer.set_buffer_size(SECTION_READER_BUFFER_SIZE);
+}
+
+// Adds the PID to the demuxer if it is new, and returns an ID for remove()
+guint SectionReader::add(guint pid, guint table_id, guint mask)
+{
+	if (pids.find(pid) == pids.end())
+	{
+		demuxer.add_pid(pid);
+		pids.insert(pid);
+	}
+
+	guint id = next_id++;
+	filter_ids[id] = section_filter.add(pid, table_id, mask, false,
+		sigc::bind(sigc::mem_fun(*this, &SectionReader::on_section), id));
+
+	return id;
+}
+
+// Sections of the filter that have not been read yet are dropped as well.  The
+// PID stays on the demuxer.
+void SectionReader::remove(guint id)
+{
+	std::map<guint, guint>::iterator filter_id = filter_ids.find(id);
+	if (filter_id == filter_ids.end())
+	{
+		return;
+	}
+
+	section_filter.remove(filter_id->second);
+	filter_ids.erase(filter_id);
+
+	std::list<Section>::iterator i = sections.begin();
+	while (i != sections.end())
+	{
+		if (i->id == id)
+		{
+			i = sections.erase(i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+void SectionReader::on_section(guint pid, const Buffer& section, guint id)
+{
+	sections.push_back(Section());
+	Section& queued = sections.back();
+	queued.id = id;
+	queued.pid = pid;
+	queued.data.assign(section.get_buffer(), section.get_buffer() + section.get_length());
+}
+
+// Returns false if no wanted section arrives within the timeout, in milliseconds
+gboolean SectionReader::read_section(Buffer& buffer, guint& pid, gint timeout)
+{
+	gint64 deadline = g_get_monotonic_time() + (gint64)timeout * 1000;
+
+	while (sections.empty())
+	{
+		gint remaining = (deadline - g_get_monotonic_time()) / 1000;
+		if (remaining <= 0 || !demuxer.poll(remaining))
+		{
+			return false;
+		}
+
+		gint bytes_read = ::read(demuxer.get_fd(), packets, sizeof(packets));
+		if (bytes_read < 0)
+		{
+			// An overflow resets the demuxer buffer, sections in progress are
+			// dropped by the continuity check
+			if (errno == EAGAIN || errno == EINTR || errno == EOVERFLOW)
+			{
+				continue;
+			}
+			throw SystemException(_("Failed to read data from demuxer"));
+		}
+
+		for (gint offset = 0; offset + TS_PACKET_SIZE <= bytes_read; offset += TS_PACKET_SIZE)
+		{
+			section_filter.push(packets + offset);
+		}
+	}
+
+	Section& section = sections.front();
+	pid = section.pid;
+	buffer.set_length(section.data.size());
+	memcpy(buffer.get_buffer(), &section.data[0], section.data.size());
+	sections.pop_front();
+
+	return true;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __DVB_SECTION_READER_H__
+#define __DVB_SECTION_READER_H__
+
+#include "dvb_demuxer.h"
+#include "dvb_section_filter.h"
+#include "mpeg_stream.h"
+#include <list>
+#include <map>
+#include <set>
+
+#define SECTION_READER_BUFFER_SIZE	(TS_PACKET_SIZE * 4096)
+
+namespace Dvb
+{
+	// Reads sections for any number of PIDs and tables through a single TS
+	// demuxer and a SectionFilter, rather than a kernel section filter per table
+	class SectionReader
+	{
+	private:
+		class Section
+		{
+		public:
+			guint				id;
+			guint				pid;
+			std::vector<guchar>	data;
+		};
+
+		Demuxer				demuxer;
+		SectionFilter		section_filter;
+		std::set<guint>		pids;
+		std::map<guint, guint>	filter_ids;
+		guint				next_id;
+		std::list<Section>	sections;
+		guchar				packets[TS_PACKET_SIZE * PACKET_BUFFER_SIZE];
+
+		void on_section(guint pid, const Buffer& section, guint id);
+
+	public:
+		SectionReader(const String& demux_path);
+
+		guint add(guint pid, guint table_id, guint mask = 0xFF);
+		void remove(guint id);
+		gboolean read_section(Buffer& buffer, guint& pid, gint timeout = read_timeout);
+	};
+}
+
+#endif
@@ -39,7 +39,7 @@ Dvb::SI::Event::Event()
 	version_number = 0;
 }
 
-SectionParser::SectionParser(const String& encoding, guint t)
+SectionParser::SectionParser(const String& encoding, guint t) : text_decoder(encoding)
 {
 	text_encoding = encoding;
 	timeout = t;
@@ -77,26 +77,31 @@ void SectionParser::parse_sds (Demuxer& demuxer, ServiceDescriptionSection& sect
 {
 	Buffer buffer;
 	demuxer.read_section(buffer, timeout);
+	parse_sds(buffer, section);
+}
+
+void SectionParser::parse_sds(const Buffer& buffer, ServiceDescriptionSection& section)
+{
 	gsize section_length = buffer.get_length();
 	
 	guint offset = 3;
-	section.transport_stream_id = buffer.get_bits(offset, 0, 16);
+	section.transport_stream_id = buffer.get_bits<0, 16>(offset);
 	offset += 8;
 	
 	while (offset < section_length - 4)
 	{
 		Service service;
 
-		service.id = buffer.get_bits(offset, 0, 16);
+		service.id = buffer.get_bits<0, 16>(offset);
 		offset += 2;
-		service.eit_schedule_flag = buffer.get_bits(offset, 6, 1) == 1;
+		service.eit_schedule_flag = buffer.get_bits<6, 1>(offset) == 1;
 		if (service.eit_schedule_flag)
 		{
 			section.epg_events_available = true;
 		}
 		offset++;
 
-		guint descriptors_loop_length = buffer.get_bits(offset, 4, 12);
+		guint descriptors_loop_length = buffer.get_bits<4, 12>(offset);
 		offset += 2;
 		guint descriptors_end_offset = offset + descriptors_loop_length;
 		while (offset < descriptors_end_offset)
@@ -121,24 +126,29 @@ void SectionParser::parse_nis (Demuxer& demuxer, NetworkInformationSection& sect
 {
 	Buffer buffer;
 	demuxer.read_section(buffer, timeout);
+	parse_nis(buffer, section);
+}
+
+void SectionParser::parse_nis(const Buffer& buffer, NetworkInformationSection& section)
+{
 	gsize section_length = buffer.get_length();
 	
 	guint offset = 8;
-	guint network_descriptor_length = buffer.get_bits(offset, 4, 12);
+	guint network_descriptor_length = buffer.get_bits<4, 12>(offset);
 	offset += 2;
 	
 	// We don't care for the network descriptors, as we only want to get new frequencies out of the stream, and they are saved in the "Transport stream descriptor" section.
 	offset += network_descriptor_length;
 	
 	// Now offset is at "transport_stream_loop_length" position.
-	guint transport_stream_length = buffer.get_bits(offset, 4, 12);
+	guint transport_stream_length = buffer.get_bits<4, 12>(offset);
 	offset += 2;
 	
 	// loop through all transport descriptors and pick out 0x43 descriptors, as they contain new frequencies.
 	while (offset < section_length - 4)
 	{
 		offset += 4;
-		guint descriptors_loop_length = buffer.get_bits(offset, 4, 12);
+		guint descriptors_loop_length = buffer.get_bits<4, 12>(offset);
 		offset += 2;
 		guint descriptors_end_offset = offset + descriptors_loop_length;
 		
@@ -161,7 +171,7 @@ void SectionParser::parse_nis (Demuxer& demuxer, NetworkInformationSection& sect
 				}
 				frontend_parameters.frequency *= 10;
 				
-				guint polarisation = (buffer.get_bits(offset + 6, 2, 1) == 1) ? POLARISATION_VERTICAL : POLARISATION_HORIZONTAL;
+				guint polarisation = (buffer.get_bits<2, 1>(offset + 6) == 1) ? POLARISATION_VERTICAL : POLARISATION_HORIZONTAL;
 				
 				frontend_parameters.u.qpsk.symbol_rate = 0;
 				for(int i=0; i<7; i++)
@@ -170,7 +180,7 @@ void SectionParser::parse_nis (Demuxer& demuxer, NetworkInformationSection& sect
 				}
 				frontend_parameters.u.qpsk.symbol_rate *= 100;
 				
-				frontend_parameters.u.qpsk.fec_inner = parse_fec_inner(buffer.get_bits(offset + 7, 28, 4));
+				frontend_parameters.u.qpsk.fec_inner = parse_fec_inner(buffer.get_bits<28, 4>(offset + 7));
 				frontend_parameters.inversion = INVERSION_AUTO;
 				
 				Transponder transponder;
@@ -196,10 +206,10 @@ void SectionParser::parse_nis (Demuxer& demuxer, NetworkInformationSection& sect
 				frequency *= 10;
 
 				// reserved_future_use (12)
-				guint fec_outer = buffer.get_bits(offset, 44, 4);
-				guint modulation = buffer.get_bits(offset, 48, 8);
-				guint symbol_rate = buffer.get_bits(offset, 56, 28);
-				guint fec_inner = buffer.get_bits(offset, 84, 4);
+				guint fec_outer = buffer.get_bits<44, 4>(offset);
+				guint modulation = buffer.get_bits<48, 8>(offset);
+				guint symbol_rate = buffer.get_bits<56, 28>(offset);
+				guint fec_inner = buffer.get_bits<84, 4>(offset);
 
 				g_debug("frequency: %d", frequency);
 				g_debug("FEC_outer: %d", fec_outer);
@@ -247,20 +257,20 @@ void SectionParser::parse_nis (Demuxer& demuxer, NetworkInformationSection& sect
 				Transponder transponder;
 
 				g_debug("Found Terrestrial Delivery System Descriptor");
-				guint centre_frequency = buffer.get_bits(offset, 0, 32) * 10;
+				guint centre_frequency = buffer.get_bits<0, 32>(offset) * 10;
 				offset += 4;
 
-				guint bandwidth = buffer.get_bits(offset, 0, 3);
+				guint bandwidth = buffer.get_bits<0, 3>(offset);
 				// priority (1)
 				// Time_Slicing_indicator (1)
 				// MPE-FEC_indicator (1)
 				// reserved_future_use (2)
-				guint constellation = buffer.get_bits(offset, 9, 2);
-				guint hierarchy_information = buffer.get_bits(offset, 11, 3);
-				guint code_rate_HP = buffer.get_bits(offset, 14, 3);
-				guint code_rate_LP = buffer.get_bits(offset, 17, 3);
-				guint guard_interval = buffer.get_bits(offset, 20, 2);
-				guint transmission_mode = buffer.get_bits(offset, 22, 2);
+				guint constellation = buffer.get_bits<9, 2>(offset);
+				guint hierarchy_information = buffer.get_bits<11, 3>(offset);
+				guint code_rate_HP = buffer.get_bits<14, 3>(offset);
+				guint code_rate_LP = buffer.get_bits<17, 3>(offset);
+				guint guard_interval = buffer.get_bits<20, 2>(offset);
+				guint transmission_mode = buffer.get_bits<22, 2>(offset);
 
 				g_debug("centre_frequency: %d", centre_frequency);
 				g_debug("bandwidth: %d", bandwidth);
@@ -384,22 +394,32 @@ void SectionParser::parse_psip_stt(Demuxer& demuxer, SystemTimeTable& table)
 {
 	Buffer buffer;
 	demuxer.read_section(buffer, timeout);
+	parse_psip_stt(buffer, table);
+}
+
+void SectionParser::parse_psip_stt(const Buffer& buffer, SystemTimeTable& table)
+{
 	gsize section_length = buffer.get_length();
 
 	guint offset = 9;
-	table.system_time = buffer.get_bits(offset, 0, 32); offset += 4;
+	table.system_time = buffer.get_bits<0, 32>(offset); offset += 4;
 	table.GPS_UTC_offset = buffer[offset++];
-	table.daylight_savings = buffer.get_bits(offset, 0, 16);
+	table.daylight_savings = buffer.get_bits<0, 16>(offset);
 }
 
 void SectionParser::parse_psip_vct(Demuxer& demuxer, VirtualChannelTable& section)
 {
 	Buffer buffer;
 	demuxer.read_section(buffer, timeout);
+	parse_psip_vct(buffer, section);
+}
+
+void SectionParser::parse_psip_vct(const Buffer& buffer, VirtualChannelTable& section)
+{
 	gsize section_length = buffer.get_length();
 
 	guint offset = 3;
-	section.transport_stream_id = buffer.get_bits(offset, 0, 16);
+	section.transport_stream_id = buffer.get_bits<0, 16>(offset);
 	offset += 6;
 	guint num_channels_in_section = buffer[offset++];
 
@@ -415,18 +435,18 @@ void SectionParser::parse_psip_vct(Demuxer& demuxer, VirtualChannelTable& sectio
 		vc.short_name = result;
 		g_free(result);
 		offset += 14;
-		vc.major_channel_number = buffer.get_bits(offset, 4, 10);
-		vc.minor_channel_number = buffer.get_bits(offset, 14, 10);
+		vc.major_channel_number = buffer.get_bits<4, 10>(offset);
+		vc.minor_channel_number = buffer.get_bits<14, 10>(offset);
 		offset += 8;
-		vc.channel_TSID = buffer.get_bits(offset, 0, 16);
+		vc.channel_TSID = buffer.get_bits<0, 16>(offset);
 		offset += 2;
-		vc.program_number = buffer.get_bits(offset, 0, 16);
+		vc.program_number = buffer.get_bits<0, 16>(offset);
 		offset += 3;
 		vc.service_type = buffer[offset++]&0x3f;
-		vc.source_id = buffer.get_bits(offset, 0, 16);
+		vc.source_id = buffer.get_bits<0, 16>(offset);
 		section.channels.push_back(vc);
 		offset += 2;
-		guint table_type_descriptors_length = buffer.get_bits(offset, 6, 10);
+		guint table_type_descriptors_length = buffer.get_bits<6, 10>(offset);
 		offset += table_type_descriptors_length + 2;
 	}
 }
@@ -435,21 +455,26 @@ void SectionParser::parse_psip_mgt(Demuxer& demuxer, MasterGuideTableArray& tabl
 {
 	Buffer buffer;
 	demuxer.read_section(buffer, timeout);
+	parse_psip_mgt(buffer, tables);
+}
+
+void SectionParser::parse_psip_mgt(const Buffer& buffer, MasterGuideTableArray& tables)
+{
 	gsize section_length = buffer.get_length();
 
 	guint offset = 9;
-	guint tables_defined = buffer.get_bits(offset, 0, 16);
+	guint tables_defined = buffer.get_bits<0, 16>(offset);
 	offset += 2;
 	
 	for (guint i = 0; i < tables_defined; i++)
 	{
 		MasterGuideTable mgt;
-		mgt.type = buffer.get_bits(offset, 0, 16);
+		mgt.type = buffer.get_bits<0, 16>(offset);
 		offset += 2;
-		mgt.pid = buffer.get_bits(offset, 3, 13);
+		mgt.pid = buffer.get_bits<3, 13>(offset);
 		tables.push_back(mgt);
 		offset += 7;
-		guint table_type_descriptors_length = buffer.get_bits(offset, 4, 12);
+		guint table_type_descriptors_length = buffer.get_bits<4, 12>(offset);
 		offset += table_type_descriptors_length + 2;
 	}
 }
@@ -458,12 +483,17 @@ void SectionParser::parse_psip_eis(Demuxer& demuxer, EventInformationSection& se
 {
 	Buffer buffer;
 	demuxer.read_section(buffer, timeout);
+	parse_psip_eis(buffer, section);
+}
+
+void SectionParser::parse_psip_eis(const Buffer& buffer, EventInformationSection& section)
+{
 	gsize section_length = buffer.get_length();
 
 	guint offset = 3;
 
-	section.service_id = buffer.get_bits(offset, 0, 16);
-	section.version_number = buffer.get_bits(42, 5);
+	section.service_id = buffer.get_bits<0, 16>(offset);
+	section.version_number = buffer.get_bits<42, 5>();
 	
 	offset += 6;
 	guint num_events_in_section = buffer[offset++];
@@ -473,9 +503,9 @@ void SectionParser::parse_psip_eis(Demuxer& demuxer, EventInformationSection& se
 		Event event;
 
 		event.version_number	= section.version_number;
-		event.event_id			= buffer.get_bits(offset, 2, 14); offset += 2;
-		event.start_time		= buffer.get_bits(offset, 0, 32); offset += 4;
-		event.duration			= buffer.get_bits(offset, 4, 20); offset += 3;
+		event.event_id			= buffer.get_bits<2, 14>(offset); offset += 2;
+		event.start_time		= buffer.get_bits<0, 32>(offset); offset += 4;
+		event.duration			= buffer.get_bits<4, 20>(offset); offset += 3;
 
 		event.start_time += GPS_EPOCH;
 		
@@ -488,7 +518,7 @@ void SectionParser::parse_psip_eis(Demuxer& demuxer, EventInformationSection& se
 			offset += title_length;
 		}
 		
-		guint descriptors_length = buffer.get_bits(offset, 4, 12);
+		guint descriptors_length = buffer.get_bits<4, 12>(offset);
 		offset += 2 + descriptors_length;
 	
 		section.events.push_back(event);
@@ -499,19 +529,24 @@ void SectionParser::parse_eis(Demuxer& demuxer, EventInformationSection& section
 {
 	Buffer buffer;
 	demuxer.read_section(buffer, timeout);
+	parse_eis(buffer, section);
+}
+
+void SectionParser::parse_eis(const Buffer& buffer, EventInformationSection& section)
+{
 	gsize section_length = buffer.get_length();
 	
 	section.table_id =						buffer[0];
-	section.section_syntax_indicator =		buffer.get_bits(8, 1);
-	section.service_id =					buffer.get_bits(24, 16);
-	section.version_number =				buffer.get_bits(42, 5);
-	section.current_next_indicator =		buffer.get_bits(47, 1);
-	section.section_number =				buffer.get_bits(48, 8);
-	section.last_section_number =			buffer.get_bits(56, 8);
-	section.transport_stream_id =			buffer.get_bits(64, 16);
-	section.original_network_id =			buffer.get_bits(80, 16);
-	section.segment_last_section_number =	buffer.get_bits(96, 8);
-	section.last_table_id =					buffer.get_bits(104, 8);
+	section.section_syntax_indicator =		buffer.get_bits<8, 1>();
+	section.service_id =					buffer.get_bits<24, 16>();
+	section.version_number =				buffer.get_bits<42, 5>();
+	section.current_next_indicator =		buffer.get_bits<47, 1>();
+	section.section_number =				buffer.get_bits<48, 8>();
+	section.last_section_number =			buffer.get_bits<56, 8>();
+	section.transport_stream_id =			buffer.get_bits<64, 16>();
+	section.original_network_id =			buffer.get_bits<80, 16>();
+	section.segment_last_section_number =	buffer.get_bits<96, 8>();
+	section.last_table_id =					buffer.get_bits<104, 8>();
 
 	unsigned int offset = 14;
 
@@ -524,12 +559,12 @@ void SectionParser::parse_eis(Demuxer& demuxer, EventInformationSection& section
 		gulong	duration;
 
 		event.version_number	= section.version_number;
-		event.event_id			= buffer.get_bits(offset, 0, 16);
-		start_time_MJD			= buffer.get_bits(offset, 16, 16);
-		start_time_UTC			= buffer.get_bits(offset, 32, 24);
-		duration				= buffer.get_bits(offset, 56, 24);
+		event.event_id			= buffer.get_bits<0, 16>(offset);
+		start_time_MJD			= buffer.get_bits<16, 16>(offset);
+		start_time_UTC			= buffer.get_bits<32, 24>(offset);
+		duration				= buffer.get_bits<56, 24>(offset);
 		
-		unsigned int descriptors_loop_length  = buffer.get_bits(offset, 84, 12);
+		unsigned int descriptors_loop_length  = buffer.get_bits<84, 12>(offset);
 		offset += 12;
 		unsigned int end_descriptor_offset = descriptors_loop_length + offset;
 
@@ -572,7 +607,7 @@ void SectionParser::parse_eis(Demuxer& demuxer, EventInformationSection& section
 			section.events.push_back(event);
 		}
 	}
-	section.crc = buffer.get_bits(offset, 0, 32);
+	section.crc = buffer.get_bits<0, 32>(offset);
 	offset += 4;
 	
 	if (offset > section_length)
@@ -650,182 +685,19 @@ gsize SectionParser::decode_event_descriptor (const guchar* event_buffer, Event&
 	return descriptor_length;
 }
 
-guint SectionParser::get_bits(const guchar* b, guint bitpos, gsize bitcount)
-{
-	gsize i;
-	gsize val = 0;
-
-	for (i = bitpos; i < bitcount + bitpos; i++)
-	{
-		val = val << 1;
-		val = val + ((b[i >> 3] & (0x80 >> (i & 7))) ? 1 : 0);
-	}
-	return val;
-}
-
 gsize SectionParser::get_text(String& s, const guchar* text_buffer)
 {
-	gsize length = text_buffer[0];
-	guint text_index = 0;
-	gchar text[length];
-	guint index = 0;
-	const gchar* codeset = "ISO-8859-15";
-	
-	if (length > 0)
+	if (text_encoding == "iso6937")
 	{
-		// Skip over length byte
-		index++;
-
-		if (text_encoding.length() > 0 && text_encoding != "auto")
-		{
-			codeset = text_encoding.c_str();
-		}
-		else // Determine codeset from stream
-		{			
-			if (text_buffer[index] < 0x20)
-			{
-				switch (text_buffer[index])
-				{
-				case 0x01: codeset = "ISO-8859-5"; break;
-				case 0x02: codeset = "ISO-8859-6"; break;
-				case 0x03: codeset = "ISO-8859-7"; break;
-				case 0x04: codeset = "ISO-8859-8"; break;
-				case 0x05: codeset = "ISO-8859-9"; break;
-				case 0x06: codeset = "ISO-8859-10"; break;
-				case 0x07: codeset = "ISO-8859-11"; break;
-				case 0x08: codeset = "ISO-8859-12"; break;
-				case 0x09: codeset = "ISO-8859-13"; break;
-				case 0x0A: codeset = "ISO-8859-14"; break;
-				case 0x0B: codeset = "ISO-8859-15"; break;
-				case 0x11: codeset = "UTF-16BE"; break;
-				case 0x14: codeset = "UTF-16BE"; break;
-
-				case 0x10:
-					{
-						// Skip 0x00
-						index++;
-						if (text_buffer[index] != 0x00)
-						{
-							g_warning("Second byte of code table id was not 0");
-						}
-						
-						index++;
-						
-						switch(text_buffer[index])
-						{
-						case 0x01: codeset = "ISO-8859-1"; break;
-						case 0x02: codeset = "ISO-8859-2"; break;
-						case 0x03: codeset = "ISO-8859-3"; break;
-						case 0x04: codeset = "ISO-8859-4"; break;
-						case 0x05: codeset = "ISO-8859-5"; break;
-						case 0x06: codeset = "ISO-8859-6"; break;
-						case 0x07: codeset = "ISO-8859-7"; break;
-						case 0x08: codeset = "ISO-8859-8"; break;
-						case 0x09: codeset = "ISO-8859-9"; break;
-						case 0x0A: codeset = "ISO-8859-10"; break;
-						case 0x0B: codeset = "ISO-8859-11"; break;
-						case 0x0C: codeset = "ISO-8859-12"; break;
-						case 0x0D: codeset = "ISO-8859-13"; break;
-						case 0x0E: codeset = "ISO-8859-14"; break;
-						case 0x0F: codeset = "ISO-8859-15"; break;
-						default: break;
-						}
-					}
-					default: break;
-				}
-				
-				index++;
-			}
-		}
-		
-		if (text_encoding == "iso6937")
+		gsize length = text_buffer[0];
+		if (length > 0)
 		{
-			s += convert_iso6937(text_buffer + index, length);
-		}
-		else
-		{
-			if (index < (length + 1))
-			{
-				while (index < (length + 1))
-				{
-					u_char ch = text_buffer[index];
-
-					if (strcmp(codeset, "UTF-16BE") == 0)
-					{
-						text[text_index++] = ch;
-					}
-					else
-					{
-						if (ch == 0x86 || ch == 0x87)
-						{
-							// Ignore formatting
-						}
-						else if (ch == 0x8A)
-						{
-							text[text_index++] = '\n';
-						}
-						else if (ch >= 0x80 && ch < 0xA0)
-						{
-							text[text_index++] = '.';
-						}
-						else
-						{
-							text[text_index++] = ch;
-						}
-					}
-					
-					index++;
-				}
-				
-				gsize bytes_read;
-				gsize bytes_written;
-				GError* error = NULL;
-				
-				gchar* result = g_convert(
-					text,
-					text_index,
-					"UTF-8",
-					codeset,
-					&bytes_read,
-					&bytes_written,
-					&error);
-				
-				if (error != NULL || result == NULL)
-				{
-					const gchar* error_message = _("No message");
-					if (error != NULL)
-					{
-						error_message = error->message;
-					}
-					
-					String message = String::compose(
-						_("Failed to convert to UTF-8: %1"),
-						String(error_message));
-					g_debug("%s", message.c_str());
-					g_debug("Codeset: %s", codeset);
-					g_debug("Length: %zu", length);
-					for (guint i = 0; i < (length+1); i++)
-					{
-						gchar ch = text_buffer[i];
-						if (!isprint(ch))
-						{
-							g_debug("text_buffer[%d]\t= 0x%02X", i, ch);
-						}
-						else
-						{
-							g_debug("text_buffer[%d]\t= 0x%02X '%c'", i, ch, ch);
-						}
-					}
-					throw Exception(message);
-				}
-				
-				s += result;
-				g_free(result);
-			}
+			s += convert_iso6937(text_buffer + 1, length);
 		}
+		return length + 1;
 	}
-	
-	return length + 1;
+
+	return text_decoder.decode(s, text_buffer);
 }
 
 String SectionParser::convert_iso6937(const guchar* text_buffer, gsize length)
@@ -27,11 +27,11 @@
 #include <fstream>
 #include <linux/dvb/frontend.h>
 #include "common.h"
+#include "mpeg_stream.h"
+#include "text_decoder.h"
 #include "i18n.h"
 
 #define DVB_SECTION_BUFFER_SIZE	16*1024
-#define TS_PACKET_SIZE			188
-#define PACKET_BUFFER_SIZE		50
 
 #define PAT_PID		0x00
 #define NIT_PID		0x10
@@ -44,6 +44,7 @@
 #define NIT_ID		0x40
 #define SDT_ID		0x42
 #define EIT_ID		0x4E
+#define TOT_ID		0x73
 #define MGT_ID		0xC7
 #define TVCT_ID		0xC8
 #define CVCT_ID		0xC9
@@ -167,9 +168,9 @@ namespace Dvb
 		private:
 			guchar buffer[DVB_SECTION_BUFFER_SIZE];
 			String text_encoding;
+			TextDecoder text_decoder;
 			guint timeout;
 				
-			guint get_bits(const guchar* buffer, guint bitpos, gsize bitcount);
 			String convert_iso6937(const guchar* buffer, gsize length);
 			gsize decode_event_descriptor (const guchar* buffer, Event& event);
 			gsize read_section(Demuxer& demuxer);
@@ -180,14 +181,22 @@ namespace Dvb
 			
 			gsize get_text(String& s, const guchar* buffer);
 			const guchar* get_buffer() const { return buffer; };
+			guint get_timeout() const { return timeout; }
 
 			void parse_eis (Demuxer& demuxer, EventInformationSection& section);
+			void parse_eis(const Buffer& buffer, EventInformationSection& section);
 			void parse_psip_eis (Demuxer& demuxer, EventInformationSection& section);
+			void parse_psip_eis(const Buffer& buffer, EventInformationSection& section);
 			void parse_psip_mgt(Demuxer& demuxer, MasterGuideTableArray& tables);
+			void parse_psip_mgt(const Buffer& buffer, MasterGuideTableArray& tables);
 			void parse_psip_vct(Demuxer& demuxer, VirtualChannelTable& section);
+			void parse_psip_vct(const Buffer& buffer, VirtualChannelTable& section);
 			void parse_psip_stt(Demuxer& demuxer, SystemTimeTable& table);
+			void parse_psip_stt(const Buffer& buffer, SystemTimeTable& table);
 			void parse_sds (Demuxer& demuxer, ServiceDescriptionSection& section);
+			void parse_sds(const Buffer& buffer, ServiceDescriptionSection& section);
 			void parse_nis (Demuxer& demuxer, NetworkInformationSection& section);
+			void parse_nis(const Buffer& buffer, NetworkInformationSection& section);
 		};
 	}
 }
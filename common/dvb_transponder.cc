@@ -76,3 +76,13 @@ bool Transponder::operator!=(struct dvb_frontend_parameters p) const
 {
 	return !(*this == p);
 }
+
+// On DVB-S a frequency is shared by the transponders of both polarisations and by
+// transponders on other satellites
+bool Transponder::is_same_multiplex(const Transponder& transponder) const
+{
+	return frontend_type == transponder.frontend_type &&
+		frontend_parameters.frequency == transponder.frontend_parameters.frequency &&
+		polarisation == transponder.polarisation &&
+		satellite_number == transponder.satellite_number;
+}
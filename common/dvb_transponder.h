@@ -46,6 +46,8 @@ namespace Dvb
 		bool operator==(struct dvb_frontend_parameters frontend_parameters) const;
 		bool operator!=(struct dvb_frontend_parameters frontend_parameters) const;
 
+		bool is_same_multiplex(const Transponder& transponder) const;
+
 		fe_type_t						frontend_type;
 		struct dvb_frontend_parameters	frontend_parameters;
 		guint							polarisation;
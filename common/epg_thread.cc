@@ -21,103 +21,109 @@
 #include "epg_thread.h"
 #include "epg_events.h"
 #include "dvb_si.h"
+#include "dvb_section_reader.h"
 #include "exception.h"
 #include "channel_manager.h"
 
-class EITDemuxers
+// The version of each EIT section that has been decoded, keyed by table ID,
+// service ID, section number and, for DVB, the transport stream and network IDs.
+// ATSC carries every time slot in table 0xCB on its own EIT-k PID, so for ATSC
+// the PID is part of the key as well.
+// The EIT carousel repeats continuously, so most sections can be dropped after
+// reading their header, before any descriptor or text decoding.
+class EitVersionMap
 {
 private:
-	GSList* eit_demuxers;
-	guint demuxer_count;
-	String demuxer_path;
+	std::map<guint64, guint> versions;
 
-public:
-	EITDemuxers(const String& path)
+	static guint64 get_key(const Buffer& buffer, gboolean is_atsc, guint pid)
 	{
-		demuxer_path = path;
-		demuxer_count = 0;
-		eit_demuxers = NULL;
+		guint64 key = ((guint64)buffer[0] << 56) | ((guint64)buffer[3] << 48) | ((guint64)buffer[4] << 40) | ((guint64)buffer[6] << 32);
+		if (is_atsc)
+		{
+			key |= pid;
+		}
+		else
+		{
+			key |= ((guint64)buffer[8] << 24) | (buffer[9] << 16) | (buffer[10] << 8) | buffer[11];
+		}
+		return key;
 	}
-	
-	~EITDemuxers()
+
+	static gboolean has_header(const Buffer& buffer, gboolean is_atsc)
 	{
-		delete_all();
+		return buffer.get_length() >= (is_atsc ? 10 : 14);
 	}
-		
-	gboolean get_next_eit(Dvb::SI::SectionParser& parser, Dvb::SI::EventInformationSection& section, gboolean is_atsc, const String& text_encoding);
-	
-	Dvb::Demuxer* add()
+
+public:
+	gboolean contains(const Buffer& buffer, gboolean is_atsc, guint pid)
 	{
-		Dvb::Demuxer* demuxer = new Dvb::Demuxer(demuxer_path);
-		eit_demuxers = g_slist_append(eit_demuxers, demuxer);
-		demuxer_count++;
-		return demuxer;
+		if (!has_header(buffer, is_atsc))
+		{
+			return false; // Let the parser deal with it
+		}
+
+		std::map<guint64, guint>::iterator i = versions.find(get_key(buffer, is_atsc, pid));
+		return i != versions.end() && i->second == (guint)((buffer[5] >> 1) & 0x1f);
 	}
 
-	void delete_all()
+	void add(const Buffer& buffer, gboolean is_atsc, guint pid)
 	{
-		while (eit_demuxers != NULL)
+		if (has_header(buffer, is_atsc))
 		{
-			delete (Dvb::Demuxer*)eit_demuxers->data;
-			eit_demuxers = g_slist_delete_link(eit_demuxers, eit_demuxers);
+			versions[get_key(buffer, is_atsc, pid)] = (buffer[5] >> 1) & 0x1f;
 		}
-		demuxer_count = 0;
 	}
 };
 
-gboolean EITDemuxers::get_next_eit(Dvb::SI::SectionParser& parser, Dvb::SI::EventInformationSection& section, gboolean is_atsc, const String& text_encoding)
+// Reads the next EIT section and decodes it, unless the same version of it has
+// already been seen, in which case changed is set to false.  Returns false when
+// no section arrives.
+static gboolean get_next_eit(Dvb::SectionReader& reader, EitVersionMap& versions, Dvb::SI::SectionParser& parser,
+	Dvb::SI::EventInformationSection& section, gboolean is_atsc, gboolean& changed)
 {
-	if (eit_demuxers == NULL)
+	Buffer buffer;
+	guint pid = 0;
+
+	changed = false;
+
+	if (!reader.read_section(buffer, pid, 2000))
 	{
-		throw Exception(_("No demuxers"));
+		g_debug("No EIT sections received");
+		return false;
 	}
-	
-	Dvb::Demuxer* selected_eit_demuxer = NULL;
-	
-	struct pollfd fds[demuxer_count];
-	guint count = 0;
-	
-	GSList* eit_demuxer = eit_demuxers;
-	while (eit_demuxer != NULL)
-	{				
-		fds[count].fd = ((Dvb::Demuxer*)eit_demuxer->data)->get_fd();
-		fds[count].events = POLLIN;
-		count++;
-		eit_demuxer = g_slist_next(eit_demuxer);
+
+	if (versions.contains(buffer, is_atsc, pid))
+	{
+		return true;
 	}
 
-	gint result = ::poll(fds, demuxer_count, 2000);
-	if (result >= 0)
+	if (is_atsc)
 	{
-		count = 0;
-		eit_demuxer = eit_demuxers;
-		while (eit_demuxer != NULL && selected_eit_demuxer == NULL)
-		{
-			Dvb::Demuxer* current = (Dvb::Demuxer*)eit_demuxer->data;
-			if ((fds[count++].revents&POLLIN) != 0)
-			{
-				selected_eit_demuxer = current;
-			}
-			eit_demuxer = g_slist_next(eit_demuxer);				
-		}
+		parser.parse_psip_eis(buffer, section);
+	}
+	else
+	{
+		parser.parse_eis(buffer, section);
+	}
+	versions.add(buffer, is_atsc, pid);
+	changed = true;
 
-		if (selected_eit_demuxer == NULL)
-		{
-			g_debug("Failed to get an EIT demuxer with events");
-			return false;
-		}
+	return true;
+}
 
-		if (is_atsc)
-		{
-			parser.parse_psip_eis(*selected_eit_demuxer, section);
-		}
-		else
-		{
-			parser.parse_eis(*selected_eit_demuxer, section);
-		}
-	}
+// Reads one section of a table that is only needed once
+static void read_table(Dvb::SectionReader& reader, guint pid, guint table_id, guint mask, gint timeout, Buffer& buffer)
+{
+	guint id = reader.add(pid, table_id, mask);
+	guint section_pid = 0;
+	gboolean received = reader.read_section(buffer, section_pid, timeout);
+	reader.remove(id);
 
-	return result >= 0;
+	if (!received)
+	{
+		throw TimeoutException(_("Read timeout"));
+	}
 }
 
 EpgThread::EpgThread(Dvb::Frontend& f, const String& encoding, guint t)
@@ -253,8 +259,8 @@ void EpgThread::run()
 {
 	try
 	{
-		String					demux_path = frontend.get_adapter().get_demux_path();
-		EITDemuxers						demuxers(demux_path);
+		Dvb::SectionReader				reader(frontend.get_adapter().get_demux_path());
+		EitVersionMap					versions;
 		Dvb::SI::SectionParser			parser(text_encoding, timeout);
 		Dvb::SI::MasterGuideTableArray	master_guide_tables;
 		Dvb::SI::VirtualChannelTable	virtual_channel_table;
@@ -265,24 +271,17 @@ void EpgThread::run()
 		gboolean is_atsc = frontend.get_frontend_type() == FE_ATSC;
 		if (is_atsc)
 		{
+			Buffer buffer;
+
 			system_time_table.GPS_UTC_offset = 15;
-			{
-				Dvb::Demuxer demuxer_stt(demux_path);
-				demuxer_stt.set_filter(PSIP_PID, STT_ID);
-				parser.parse_psip_stt(demuxer_stt, system_time_table);
-			}
+			read_table(reader, PSIP_PID, STT_ID, 0xFF, timeout, buffer);
+			parser.parse_psip_stt(buffer, system_time_table);
 
-			{
-				Dvb::Demuxer demuxer_vct(demux_path);
-				demuxer_vct.set_filter(PSIP_PID, TVCT_ID, 0xFE);
-				parser.parse_psip_vct(demuxer_vct, virtual_channel_table);
-			}
+			read_table(reader, PSIP_PID, TVCT_ID, 0xFE, timeout, buffer);
+			parser.parse_psip_vct(buffer, virtual_channel_table);
 
-			{
-				Dvb::Demuxer demuxer_mgt(demux_path);
-				demuxer_mgt.set_filter(PSIP_PID, MGT_ID);
-				parser.parse_psip_mgt(demuxer_mgt, master_guide_tables);
-			}
+			read_table(reader, PSIP_PID, MGT_ID, 0xFF, timeout, buffer);
+			parser.parse_psip_mgt(buffer, master_guide_tables);
 
 			guint i = master_guide_tables.size();
 			if (i > 0) do
@@ -291,14 +290,14 @@ void EpgThread::run()
 				Dvb::SI::MasterGuideTable mgt = master_guide_tables[i];
 				if (mgt.type >= 0x0100 && mgt.type <= 0x017F)
 				{
-					demuxers.add()->set_filter(mgt.pid, PSIP_EIT_ID, 0);
+					reader.add(mgt.pid, PSIP_EIT_ID, 0);
 					g_debug("Set up PID 0x%02X for events", mgt.pid);
 				}
 			} while (i > 0);
 		}
 		else
 		{
-			demuxers.add()->set_filter(EIT_PID, EIT_ID, 0);
+			reader.add(EIT_PID, EIT_ID, 0);
 		}
 
 		EpgEventList epg_events = EpgEvents::get_all();
@@ -315,12 +314,13 @@ void EpgThread::run()
 			try
 			{
 				Dvb::SI::EventInformationSection section;
+				gboolean changed = false;
 			
-				if (!demuxers.get_next_eit(parser, section, is_atsc, text_encoding))
+				if (!get_next_eit(reader, versions, parser, section, is_atsc, changed))
 				{
 					terminate();
 				}
-				else
+				else if (changed)
 				{
 					guint service_id = section.service_id;
 				
@@ -411,13 +411,14 @@ void EpgThread::run()
 							}
 						}
 					}
+				}
 
-					time_t now = time(NULL);
-					if (now - last_save > 10)
-					{
-						last_save = now;
-						epg_cache.save();
-					}
+				// Repeated sections still give pending events their chance to be saved
+				time_t now = time(NULL);
+				if (now - last_save > 10)
+				{
+					last_save = now;
+					epg_cache.save();
 				}
 			}
 			catch(const Glib::Exception& ex)
@@ -22,21 +22,26 @@
 #include "dvb_si.h"
 #include "exception.h"
 #include "common.h"
+#include "pmt_cache.h"
 
 FrontendThread::FrontendThread(Dvb::Frontend& f, const String& encoding, guint t, gboolean i)
-	: Thread("Frontend"), frontend(f), text_encoding(encoding), timeout(t), ignore_teletext(i)
+	: Thread("Frontend"), psi_updater(*this), frontend(f), text_encoding(encoding), timeout(t), ignore_teletext(i)
 {
 	g_debug("Creating FrontendThread (%s)", frontend.get_path().c_str());
 	
+	g_static_rec_mutex_init(mutex.gobj());
+	g_static_mutex_init(psi_mutex.gobj());
+	g_static_mutex_init(section_mutex.gobj());
+	section_filter_count = 0;
 	epg_thread = NULL;
+	snapshot = new StreamSnapshot(streams);
+	reader_generation = 0;
 
-	String input_path = frontend.get_adapter().get_dvr_path();
+	String input_path = frontend.get_adapter().get_demux_path();
 
-	g_debug("Opening frontend device '%s' for reading ...", input_path.c_str());
-	if ( (dvr_fd = ::open(input_path.c_str(), O_RDONLY | O_NONBLOCK) ) < 0 )
-	{
-		throw SystemException("Failed to open dvr device");
-	}
+	g_debug("Opening demux device '%s' for reading ...", input_path.c_str());
+	ts_demuxer = new Dvb::Demuxer(input_path);
+	ts_demuxer->set_buffer_size(TS_DEMUXER_BUFFER_SIZE);
 	
 	g_debug("FrontendThread created (%s)", frontend.get_path().c_str());
 }
@@ -45,26 +50,34 @@ FrontendThread::~FrontendThread()
 {
 	g_debug("Destroying FrontendThread (%s)", frontend.get_path().c_str());
 	
-	g_debug("About to close input channel ...");
-	::close(dvr_fd);
-	
 	stop();
+	psi_updater.join(true);
 	stop_epg_thread();
+	delete snapshot;
+
+	g_debug("About to close input channel ...");
+	delete ts_demuxer;
 	
 	g_debug("FrontendThread destroyed (%s)", frontend.get_path().c_str());
 }
 
 void FrontendThread::start()
 {
+	Glib::RecMutex::Lock lock(mutex);
 	if (!streams.empty() && is_terminated())
 	{
 		g_debug("Starting frontend thread (%s)", frontend.get_path().c_str());
+		if (!psi_updater.is_started())
+		{
+			psi_updater.start();
+		}
 		Thread::start();
 	}
 }
 
 void FrontendThread::stop()
 {
+	Glib::RecMutex::Lock lock(mutex);
 	g_debug("Stopping frontend thread (%s)", frontend.get_path().c_str());
 	join(true);
 	g_debug("Frontend thread stopped and joined (%s)", frontend.get_path().c_str());
@@ -75,15 +88,28 @@ void FrontendThread::run()
 	g_debug("Frontend thread running (%s)", frontend.get_path().c_str());
 
 	struct pollfd pfds[1];
-	pfds[0].fd = dvr_fd;
+	pfds[0].fd = ts_demuxer->get_fd();
 	pfds[0].events = POLLIN;
 	
-	guchar buffer[TS_PACKET_SIZE * PACKET_BUFFER_SIZE];
+	PacketBlock* block = NULL;
+	guint64 sequence = 0;
+	StreamSnapshot* previous = NULL;
+	PsiUpdateList updates;
 
 	g_debug("Entering FrontendThread loop (%s)", frontend.get_path().c_str());
 	while (!is_terminated())
 	{
-		if (streams.empty())
+		// Tells publish_snapshot() that the previous pass is finished with its snapshot
+		g_atomic_int_inc(&reader_generation);
+
+		StreamSnapshot* current = (StreamSnapshot*)g_atomic_pointer_get(&snapshot);
+		if (current != previous)
+		{
+			// Report the PAT/PMT of new or changed streams again
+			psi_tracker.reset();
+			previous = current;
+		}
+		if (current->streams.empty() && g_atomic_int_get(&section_filter_count) == 0)
 		{
 			usleep(100000);
 			continue;
@@ -96,7 +122,12 @@ void FrontendThread::run()
 				throw SystemException("Frontend poll failed");
 			}
 
-			gint bytes_read = ::read(dvr_fd, buffer, TS_PACKET_SIZE * PACKET_BUFFER_SIZE);
+			if (block == NULL)
+			{
+				block = PacketBlock::acquire();
+			}
+
+			gint bytes_read = ::read(pfds[0].fd, block->data, TS_PACKET_SIZE * PACKET_BUFFER_SIZE);
 
 			if (bytes_read < 0)
 			{
@@ -105,22 +136,67 @@ void FrontendThread::run()
 					continue;
 				}
 
+				// The demuxer buffer has been reset, carry on with the next read
+				if (errno == EOVERFLOW)
+				{
+					g_message("Demuxer buffer overflow (%s)", frontend.get_path().c_str());
+					continue;
+				}
+
 				String message = String::compose("Frontend read failed (%1)", frontend.get_path());
 				throw SystemException(message);
 			}
 
+			block->length = bytes_read;
+			block->sequence = sequence++;
+
+			if (g_atomic_int_get(&section_filter_count) > 0)
+			{
+				Glib::Mutex::Lock lock(section_mutex);
+				for (guint offset = 0; offset < (guint)bytes_read; offset += TS_PACKET_SIZE)
+				{
+					section_filter.push(block->data + offset);
+				}
+			}
+
 			for (guint offset = 0; offset < (guint)bytes_read; offset += TS_PACKET_SIZE)
 			{
-				guint pid = ((buffer[offset+1] & 0x1f) << 8) + buffer[offset+2];
+				const guchar* packet = block->data + offset;
+				guint pid = ((packet[1] & 0x1f) << 8) + packet[2];
 
-				for (ChannelStreamList::iterator i = streams.begin(); i != streams.end(); i++)
+				if (current->psi_pids[pid])
 				{
-					ChannelStream& channel_stream = **i;
-					if (channel_stream.stream.contains_pid(pid))
-					{
-						channel_stream.write(buffer+offset, TS_PACKET_SIZE);
-					}
+					psi_tracker.push(packet, current->transponder, current->services, updates);
 				}
+
+				ChannelStreamArray& subscribers = current->pid_subscribers[current->pid_map[pid]];
+				gsize subscriber_count = subscribers.size();
+				for (guint i = 0; i < subscriber_count; i++)
+				{
+					subscribers[i]->write(block, offset);
+				}
+
+				subscriber_count = current->all_pid_subscribers.size();
+				for (guint i = 0; i < subscriber_count; i++)
+				{
+					current->all_pid_subscribers[i]->write(block, offset);
+				}
+			}
+
+			gsize stream_count = current->streams.size();
+			for (guint i = 0; i < stream_count; i++)
+			{
+				current->streams[i]->commit();
+			}
+
+			// The streams hold their own references to the block now
+			block->unreference();
+			block = NULL;
+
+			if (!updates.empty())
+			{
+				Glib::Mutex::Lock lock(psi_mutex);
+				psi_updates.splice(psi_updates.end(), updates);
 			}
 		}
 		catch(...)
@@ -128,79 +204,473 @@ void FrontendThread::run()
 			// The show must go on!
 		}
 	}
+
+	if (block != NULL)
+	{
+		block->unreference();
+	}
 		
 	g_debug("FrontendThread loop exited (%s)", frontend.get_path().c_str());
 }
 
+// Keeps the first section given to it by a section filter, for a thread that
+// is waiting for it
+class SectionRequest
+{
+public:
+	SectionRequest(gint e) : table_id_extension(e), received(false) {}
+
+	gint			table_id_extension;
+	volatile gint	received;
+	Buffer			section;
+
+	void on_section(guint pid, const Buffer& s)
+	{
+		if (g_atomic_int_get(&received) || s.get_length() < 8 ||
+			(table_id_extension >= 0 && ((s[3] << 8) | s[4]) != table_id_extension))
+		{
+			return;
+		}
+
+		section.set_length(s.get_length());
+		memcpy(section.get_buffer(), s.get_buffer(), s.get_length());
+		g_atomic_int_set(&received, true);
+	}
+};
+
+// Reads the PAT and then the PMT for a service, returns the PMT PID
+guint FrontendThread::read_pmt(guint service_id, Buffer& buffer)
+{
+	Mpeg::Stream stream;
+
+	g_debug("Reading PAT");
+	read_section(PAT_PID, PAT_ID, -1, buffer);
+	stream.set_pmt_pid(buffer, service_id);
+
+	g_debug("Reading PMT");
+	read_section(stream.get_pmt_pid(), PMT_ID, service_id, buffer);
+
+	return stream.get_pmt_pid();
+}
+
+// Reads a section from the TS demuxer that the streams are read from, rather than
+// opening a section demuxer.  While the frontend thread is running it passes the
+// packets to the section filter, otherwise they are read here.  Call with mutex
+// held.  A negative table_id_extension matches any section of the table.
+void FrontendThread::read_section(guint pid, guint table_id, gint table_id_extension, Buffer& buffer)
+{
+	SectionRequest request(table_id_extension);
+	gboolean running = is_started() && !is_terminated();
+	guint filter_id = 0;
+
+	// Without the frontend thread nothing has emptied the demuxer since the last
+	// stream stopped, possibly on another transponder
+	if (!running)
+	{
+		read_demuxer_sections(true);
+	}
+
+	reference_pid(pid);
+	{
+		Glib::Mutex::Lock lock(section_mutex);
+		section_filter.reset();
+		filter_id = section_filter.add(pid, table_id, 0xFF, false, sigc::mem_fun(request, &SectionRequest::on_section));
+	}
+	g_atomic_int_inc(&section_filter_count);
+
+	gint64 deadline = g_get_monotonic_time() + (gint64)timeout * 1000;
+	try
+	{
+		while (!g_atomic_int_get(&request.received) && g_get_monotonic_time() < deadline)
+		{
+			if (running)
+			{
+				usleep(2000);
+			}
+			else
+			{
+				read_demuxer_sections(false);
+			}
+		}
+	}
+	catch(const Glib::Exception& ex)
+	{
+		g_message("Failed to read section from PID %d: %s", pid, ex.what().c_str());
+	}
+
+	g_atomic_int_add(&section_filter_count, -1);
+	{
+		Glib::Mutex::Lock lock(section_mutex);
+		section_filter.remove(filter_id);
+	}
+	unreference_pid(pid);
+
+	if (!g_atomic_int_get(&request.received))
+	{
+		throw TimeoutException(_("Read timeout"));
+	}
+
+	buffer.set_length(request.section.get_length());
+	memcpy(buffer.get_buffer(), request.section.get_buffer(), request.section.get_length());
+}
+
+// Passes whatever the TS demuxer has to the section filter, or throws it away,
+// only while the frontend thread is not running
+void FrontendThread::read_demuxer_sections(gboolean discard)
+{
+	guchar packets[TS_PACKET_SIZE * PACKET_BUFFER_SIZE];
+	guint count = 0;
+
+	while (ts_demuxer->poll(discard ? 0 : 100))
+	{
+		gint bytes_read = ::read(ts_demuxer->get_fd(), packets, sizeof(packets));
+		if (bytes_read < 0)
+		{
+			if (errno == EAGAIN || errno == EINTR || errno == EOVERFLOW)
+			{
+				return;
+			}
+			throw SystemException("Frontend read failed");
+		}
+
+		if (!discard)
+		{
+			Glib::Mutex::Lock lock(section_mutex);
+			for (gint offset = 0; offset + TS_PACKET_SIZE <= bytes_read; offset += TS_PACKET_SIZE)
+			{
+				section_filter.push(packets + offset);
+			}
+			return;
+		}
+
+		if (bytes_read == 0 || ++count >= TS_DEMUXER_BUFFER_SIZE / sizeof(packets))
+		{
+			return;
+		}
+	}
+}
+
 void FrontendThread::setup_dvb(ChannelStream& channel_stream)
 {
 	g_debug("Setting up DVB");
 
-	String demux_path = frontend.get_adapter().get_demux_path();
-
 	Buffer buffer;
 	const Channel& channel = channel_stream.channel;
 	
-	channel_stream.clear_demuxers();
 	if (channel.transponder != frontend.get_frontend_parameters())
 	{
 		stop_epg_thread();
 		frontend.tune_to(channel.transponder);
 	}
 	start_epg_thread();
-	
-	g_debug("Reading PAT");
-	Dvb::Demuxer demuxer_pat(demux_path);
-	demuxer_pat.set_filter(PAT_PID, PAT_ID);
 
-	Mpeg::Stream& stream = channel_stream.stream;
+	gboolean cached = false;
+	guint pmt_pid = 0;
 
-	demuxer_pat.read_section(buffer);
+	if (PmtCache::find(channel.transponder, channel.service_id, pmt_pid, buffer))
+	{
+		try
+		{
+			channel_stream.set_layout(pmt_pid, buffer, ignore_teletext);
+			cached = true;
+			g_debug("Using cached PMT for '%s'", channel.name.c_str());
+		}
+		catch(const Glib::Exception& ex)
+		{
+			g_message("Ignoring cached PMT for '%s': %s", channel.name.c_str(), ex.what().c_str());
+		}
+	}
 
-	stream.clear();
-	stream.set_pmt_pid(buffer, channel.service_id);
+	// A cached PMT is checked by the PSI tracker once the stream is running
+	if (!cached)
+	{
+		pmt_pid = read_pmt(channel.service_id, buffer);
+		channel_stream.set_layout(pmt_pid, buffer, ignore_teletext);
+		PmtCache::store(channel.transponder, channel.service_id, pmt_pid, buffer);
+	}
 
-	demuxer_pat.stop();
+	reference_pids(channel_stream);
 
-	g_debug("Reading PMT");
-	Dvb::Demuxer demuxer_pmt(demux_path);
-	demuxer_pmt.set_filter(stream.get_pmt_pid(), PMT_ID);
-	demuxer_pmt.read_section(buffer);
-	demuxer_pmt.stop();
+	g_debug("Finished setting up DVB (%s)", frontend.get_path().c_str());
+}
 
-	stream.parse_pms(buffer, ignore_teletext);
+void FrontendThread::run_psi_updater()
+{
+	g_debug("PSI updater running (%s)", frontend.get_path().c_str());
 
-	guint pcr_pid = stream.get_pcr_pid();
-	if (pcr_pid != 0x1FFF)
+	while (!psi_updater.is_terminated())
 	{
-		channel_stream.add_pes_demuxer(demux_path, pcr_pid, DMX_PES_OTHER, "PCR");
+		PsiUpdateList updates;
+
+		{
+			Glib::Mutex::Lock lock(psi_mutex);
+			updates.swap(psi_updates);
+		}
+
+		if (updates.empty())
+		{
+			usleep(100000);
+			continue;
+		}
+
+		for (PsiUpdateList::iterator i = updates.begin(); i != updates.end(); i++)
+		{
+			try
+			{
+				apply_psi_update(*i);
+			}
+			catch(const Glib::Exception& ex)
+			{
+				g_message("Failed to apply PSI update for service %d: %s", i->service_id, ex.what().c_str());
+			}
+			catch(...)
+			{
+				g_message("Failed to apply PSI update for service %d", i->service_id);
+			}
+		}
 	}
-	
-	gsize video_streams_size = stream.video_streams.size();
-	for (guint i = 0; i < video_streams_size; i++)
+
+	g_debug("PSI updater exited (%s)", frontend.get_path().c_str());
+}
+
+// Applies a PAT/PMT change seen by the frontend thread to the streams for that
+// service, without restarting them
+void FrontendThread::apply_psi_update(const PsiUpdate& update)
+{
+	Glib::RecMutex::Lock lock(mutex);
+
+	ChannelStreamList matching_streams;
+	for (ChannelStreamList::iterator i = streams.begin(); i != streams.end(); i++)
 	{
-		channel_stream.add_pes_demuxer(demux_path, stream.video_streams[i].pid, DMX_PES_OTHER, "video");
+		ChannelStream* channel_stream = *i;
+		if (channel_stream->channel.service_id == update.service_id &&
+			channel_stream->channel.transponder.is_same_multiplex(update.transponder) &&
+			channel_stream->type != CHANNEL_STREAM_TYPE_MULTIPLEX_RECORDING)
+		{
+			matching_streams.push_back(channel_stream);
+		}
 	}
 
-	gsize audio_streams_size = stream.audio_streams.size();
-	for (guint i = 0; i < audio_streams_size; i++)
+	// The streams have been stopped or moved to another multiplex since the update was seen
+	if (matching_streams.empty())
 	{
-		channel_stream.add_pes_demuxer(demux_path, stream.audio_streams[i].pid, DMX_PES_OTHER, "audio");
+		return;
 	}
-				
-	gsize subtitle_streams_size = stream.subtitle_streams.size();
-	for (guint i = 0; i < subtitle_streams_size; i++)
+
+	Buffer buffer;
+	if (update.section.empty())
 	{
-		channel_stream.add_pes_demuxer(demux_path, stream.subtitle_streams[i].pid, DMX_PES_OTHER, "subtitle");
+		g_message("PMT for service %d has moved to PID %d", update.service_id, update.pmt_pid);
+	}
+	else
+	{
+		buffer.set_length(update.section.size());
+		memcpy(buffer.get_buffer(), &update.section[0], update.section.size());
+
+		if (!PmtCache::store(update.transponder, update.service_id, update.pmt_pid, buffer))
+		{
+			return;
+		}
+
+		g_message("PMT for service %d has changed, updating streams", update.service_id);
 	}
 
-	gsize teletext_streams_size = stream.teletext_streams.size();
-	for (guint i = 0; i < teletext_streams_size; i++)
+	for (ChannelStreamList::iterator i = matching_streams.begin(); i != matching_streams.end(); i++)
 	{
-		channel_stream.add_pes_demuxer(demux_path, stream.teletext_streams[i].pid, DMX_PES_OTHER, "teletext");
+		ChannelStream* channel_stream = *i;
+
+		unreference_pids(*channel_stream);
+		if (update.section.empty())
+		{
+			channel_stream->stream.set_pmt_pid(update.pmt_pid);
+		}
+		else
+		{
+			channel_stream->set_layout(update.pmt_pid, buffer, ignore_teletext);
+		}
+		reference_pids(*channel_stream);
 	}
 
-	g_debug("Finished setting up DVB (%s)", frontend.get_path().c_str());
+	ChannelStreamList removed_streams;
+	publish_snapshot(removed_streams);
+}
+
+// Builds the PID -> subscriber lookup used by run().  PIDs that are wanted by the
+// same set of streams share one entry in pid_subscribers, entry 0 is always empty.
+StreamSnapshot::StreamSnapshot(const ChannelStreamList& stream_list)
+	: streams(stream_list.begin(), stream_list.end())
+{
+	memset(psi_pids, 0, sizeof(psi_pids));
+
+	std::map<guint, ChannelStreamArray> subscribers_by_pid;
+
+	for (ChannelStreamArray::iterator i = streams.begin(); i != streams.end(); i++)
+	{
+		ChannelStream* channel_stream = *i;
+		if (channel_stream->type == CHANNEL_STREAM_TYPE_MULTIPLEX_RECORDING)
+		{
+			all_pid_subscribers.push_back(channel_stream);
+			continue;
+		}
+
+		std::vector<guint> pids = channel_stream->stream.get_pids();
+		for (std::vector<guint>::iterator j = pids.begin(); j != pids.end(); j++)
+		{
+			subscribers_by_pid[*j & (PID_COUNT - 1)].push_back(channel_stream);
+		}
+
+		guint pmt_pid = channel_stream->stream.get_pmt_pid() & (PID_COUNT - 1);
+		services[channel_stream->channel.service_id] = pmt_pid;
+		psi_pids[PAT_PID] = true;
+		psi_pids[pmt_pid] = true;
+		transponder = channel_stream->channel.transponder;
+	}
+
+	memset(pid_map, 0, sizeof(pid_map));
+	pid_subscribers.push_back(ChannelStreamArray());
+
+	for (std::map<guint, ChannelStreamArray>::iterator i = subscribers_by_pid.begin(); i != subscribers_by_pid.end(); i++)
+	{
+		guint index = 1;
+		while (index < pid_subscribers.size() && pid_subscribers[index] != i->second)
+		{
+			index++;
+		}
+
+		if (index == pid_subscribers.size())
+		{
+			pid_subscribers.push_back(i->second);
+		}
+
+		pid_map[i->first] = index;
+	}
+}
+
+// Swaps in a snapshot of the current stream list without stopping the frontend thread.
+// The old snapshot and the removed streams are only destroyed once the frontend thread
+// has started a new pass, so it can never see them again.  Call with mutex held.
+void FrontendThread::publish_snapshot(ChannelStreamList& removed_streams)
+{
+	for (ChannelStreamList::iterator i = removed_streams.begin(); i != removed_streams.end(); i++)
+	{
+		unreference_pids(**i);
+	}
+
+	StreamSnapshot* old_snapshot = snapshot;
+	g_atomic_pointer_set(&snapshot, new StreamSnapshot(streams));
+
+	if (is_started())
+	{
+		gint generation = g_atomic_int_get(&reader_generation);
+		while (g_atomic_int_get(&reader_generation) == generation && !is_terminated())
+		{
+			usleep(1000);
+		}
+	}
+
+	delete old_snapshot;
+
+	for (ChannelStreamList::iterator i = removed_streams.begin(); i != removed_streams.end(); i++)
+	{
+		delete *i;
+	}
+	removed_streams.clear();
+
+	g_debug("Stream snapshot published: %u streams, %u subscriber lists (%s)",
+		(guint)snapshot->streams.size(), (guint)snapshot->pid_subscribers.size() - 1, frontend.get_path().c_str());
+}
+
+// The elementary PIDs go to the streams, the PAT and PMT go to the PSI tracker
+static std::vector<guint> get_filter_pids(const ChannelStream& channel_stream)
+{
+	std::vector<guint> pids;
+
+	if (channel_stream.type == CHANNEL_STREAM_TYPE_MULTIPLEX_RECORDING)
+	{
+		pids.push_back(ALL_PIDS);
+	}
+	else
+	{
+		pids = channel_stream.stream.get_pids();
+		pids.push_back(PAT_PID);
+		pids.push_back(channel_stream.stream.get_pmt_pid());
+	}
+
+	return pids;
+}
+
+// A PID is only added to the TS demuxer once, however many streams or section
+// reads want it.  While the whole multiplex is wanted the demuxer only has ALL_PIDS,
+// otherwise the kernel would deliver the other PIDs twice.
+void FrontendThread::reference_pid(guint pid)
+{
+	gboolean all_pids = pid_references.find(ALL_PIDS) != pid_references.end();
+
+	if (pid_references[pid] == 0)
+	{
+		if (pid == ALL_PIDS)
+		{
+			g_debug("Adding all PIDs to TS demuxer");
+			ts_demuxer->add_pid(ALL_PIDS);
+			for (std::map<guint, guint>::iterator j = pid_references.begin(); j != pid_references.end(); j++)
+			{
+				if (j->first != ALL_PIDS)
+				{
+					ts_demuxer->remove_pid(j->first);
+				}
+			}
+		}
+		else if (!all_pids)
+		{
+			g_debug("Adding PID %d (0x%X) to TS demuxer", pid, pid);
+			ts_demuxer->add_pid(pid);
+		}
+	}
+	pid_references[pid]++;
+}
+
+void FrontendThread::unreference_pid(guint pid)
+{
+	std::map<guint, guint>::iterator references = pid_references.find(pid);
+	if (references == pid_references.end() || --references->second > 0)
+	{
+		return;
+	}
+
+	pid_references.erase(references);
+
+	if (pid == ALL_PIDS)
+	{
+		g_debug("Removing all PIDs from TS demuxer");
+		for (std::map<guint, guint>::iterator j = pid_references.begin(); j != pid_references.end(); j++)
+		{
+			ts_demuxer->add_pid(j->first);
+		}
+		ts_demuxer->remove_pid(ALL_PIDS);
+	}
+	else if (pid_references.find(ALL_PIDS) == pid_references.end())
+	{
+		g_debug("Removing PID %d (0x%X) from TS demuxer", pid, pid);
+		ts_demuxer->remove_pid(pid);
+	}
+}
+
+void FrontendThread::reference_pids(const ChannelStream& channel_stream)
+{
+	std::vector<guint> pids = get_filter_pids(channel_stream);
+	for (std::vector<guint>::iterator i = pids.begin(); i != pids.end(); i++)
+	{
+		reference_pid(*i);
+	}
+}
+
+void FrontendThread::unreference_pids(const ChannelStream& channel_stream)
+{
+	std::vector<guint> pids = get_filter_pids(channel_stream);
+	for (std::vector<guint>::iterator i = pids.begin(); i != pids.end(); i++)
+	{
+		unreference_pid(*i);
+	}
 }
 
 void FrontendThread::start_epg_thread()
@@ -230,45 +700,185 @@ void FrontendThread::stop_epg_thread()
 	}
 }
 
-void FrontendThread::start_broadcasting(Channel& channel, int client_id, const String& interface, const String& address, int port)
+BroadcastingChannelStream* FrontendThread::find_broadcast(const Channel& channel)
+{
+	for (ChannelStreamList::iterator i = streams.begin(); i != streams.end(); i++)
+	{
+		ChannelStream* channel_stream = *i;
+		if (channel_stream->type == CHANNEL_STREAM_TYPE_BROADCAST && channel_stream->channel.id == channel.id)
+		{
+			return (BroadcastingChannelStream*)channel_stream;
+		}
+	}
+
+	return NULL;
+}
+
+gboolean FrontendThread::is_broadcasting(const Channel& channel)
+{
+	Glib::RecMutex::Lock lock(mutex);
+	return find_broadcast(channel) != NULL;
+}
+
+// Clients of a channel that is already being broadcast are added to the existing
+// stream, returns the port that the client will be sent to
+int FrontendThread::start_broadcasting(Channel& channel, int client_id, const String& interface, const String& address, int port, gboolean multicast, gboolean rtp)
 {
 	g_debug("FrontendThread::start_broadcast(%s)", channel.name.c_str());
-	stop();
+	Glib::RecMutex::Lock lock(mutex);
+
+	BroadcastingChannelStream* existing_stream = find_broadcast(channel);
+	if (existing_stream != NULL)
+	{
+		g_debug("Adding client to existing stream output");
+		return existing_stream->add_client(client_id, address, port, multicast, rtp);
+	}
 	
 	g_debug("Creating new stream output");
 
-	BroadcastingChannelStream* channel_stream = new BroadcastingChannelStream(channel, client_id, interface, address, port);
+	BroadcastingChannelStream* channel_stream = new BroadcastingChannelStream(channel, interface);
+	int client_port = channel_stream->add_client(client_id, address, port, multicast, rtp);
+	start_broadcast(channel_stream);
+
+	return client_port;
+}
+
+// Sends a channel to a stream sink, for clients on a connection or in shared
+// memory rather than UDP
+void FrontendThread::start_broadcasting(Channel& channel, int client_id, StreamSink* sink, gboolean owns_sink)
+{
+	g_debug("FrontendThread::start_broadcast(%s)", channel.name.c_str());
+	Glib::RecMutex::Lock lock(mutex);
+
+	BroadcastingChannelStream* existing_stream = find_broadcast(channel);
+	if (existing_stream != NULL)
+	{
+		g_debug("Adding client to existing stream output");
+		existing_stream->add_client(client_id, sink, owns_sink);
+		return;
+	}
+
+	g_debug("Creating new stream output");
+
+	BroadcastingChannelStream* channel_stream = new BroadcastingChannelStream(channel, multicast_interface);
+	channel_stream->add_client(client_id, sink, owns_sink);
+	start_broadcast(channel_stream);
+}
+
+// Starts a new broadcast stream that already has its first client
+void FrontendThread::start_broadcast(BroadcastingChannelStream* channel_stream)
+{
 	setup_dvb(*channel_stream);
 	streams.push_back(channel_stream);
 
+	ChannelStreamList removed_streams;
+	publish_snapshot(removed_streams);
+
+	// The writer is started after priming so the cached GOP goes out first
+	prime_stream(*channel_stream);
+	channel_stream->start();
+
 	start();
 }
 
+// Gives a new stream the GOP cached by another stream of the same channel.  The
+// new stream is already subscribed, so this waits until the other stream's writer
+// has caught up with the first packet the new stream was given.
+void FrontendThread::prime_stream(ChannelStream& channel_stream)
+{
+	ChannelStream* source = NULL;
+	for (ChannelStreamList::iterator i = streams.begin(); i != streams.end() && source == NULL; i++)
+	{
+		ChannelStream* other = *i;
+		if (other != &channel_stream && other->channel.id == channel_stream.channel.id &&
+			other->type != CHANNEL_STREAM_TYPE_MULTIPLEX_RECORDING)
+		{
+			source = other;
+		}
+	}
+
+	if (source == NULL)
+	{
+		return;
+	}
+
+	std::vector<guchar> data;
+	guint64 position = 0;
+	gint64 deadline = g_get_monotonic_time() + GOP_CACHE_TIMEOUT;
+	while (!channel_stream.get_first_position(position) || !source->get_gop(position, data))
+	{
+		if (g_get_monotonic_time() >= deadline)
+		{
+			g_debug("Timed out waiting for the GOP cache of '%s'", channel_stream.channel.name.c_str());
+			return;
+		}
+		usleep(2000);
+	}
+
+	g_debug("Priming stream with %zu cached bytes", data.size());
+	channel_stream.set_primer(data);
+}
+
 void FrontendThread::stop_broadcasting(int client_id)
 {
-	stop();
-	gboolean found = false;
+	Glib::RecMutex::Lock lock(mutex);
+	ChannelStreamList removed_streams;
 
 	ChannelStreamList::iterator iterator = streams.begin();
 
-	while (iterator != streams.end() && !found)
+	while (iterator != streams.end() && removed_streams.empty())
 	{
 		ChannelStream* channel_stream = *iterator;
-		if (channel_stream->type == CHANNEL_STREAM_TYPE_BROADCAST)
+		if (channel_stream->type == CHANNEL_STREAM_TYPE_BROADCAST &&
+			((BroadcastingChannelStream*)channel_stream)->has_client(client_id))
 		{
-			if (((BroadcastingChannelStream*)channel_stream)->get_client_id() == client_id)
+			BroadcastingChannelStream* broadcasting_stream = (BroadcastingChannelStream*)channel_stream;
+			broadcasting_stream->remove_client(client_id);
+			if (broadcasting_stream->has_clients())
 			{
-				delete channel_stream;
-				iterator = streams.erase(iterator);
-				g_debug("Stopped broadcast stream");
-				found = true;
+				return;
 			}
+
+			removed_streams.push_back(channel_stream);
+			iterator = streams.erase(iterator);
+			g_debug("Stopped broadcast stream");
 		}
+		else
+		{
+			iterator++;
+		}
+	}
 
-		iterator++;
+	// Other frontends are asked too, only one that changed has anything to publish
+	if (removed_streams.empty())
+	{
+		return;
 	}
 
-	start();
+	publish_snapshot(removed_streams);
+
+	if (streams.empty())
+	{
+		stop();
+	}
+}
+
+gboolean FrontendThread::timeshift(int client_id, TimeshiftAction action, guint seconds)
+{
+	Glib::RecMutex::Lock lock(mutex);
+
+	for (ChannelStreamList::iterator i = streams.begin(); i != streams.end(); i++)
+	{
+		ChannelStream* channel_stream = *i;
+		if (channel_stream->type == CHANNEL_STREAM_TYPE_BROADCAST &&
+			((BroadcastingChannelStream*)channel_stream)->has_client(client_id))
+		{
+			((BroadcastingChannelStream*)channel_stream)->timeshift(client_id, action, seconds);
+			return true;
+		}
+	}
+
+	return false;
 }
 
 String make_recording_filename(Channel& channel, const String& description)
@@ -323,7 +933,8 @@ void FrontendThread::start_recording(Channel& channel,
                                      const String& description,
                                      gboolean scheduled)
 {
-	stop();	
+	Glib::RecMutex::Lock lock(mutex);
+	ChannelStreamList removed_streams;
 
 	ChannelStreamType requested_type = scheduled ? CHANNEL_STREAM_TYPE_SCHEDULED_RECORDING : CHANNEL_STREAM_TYPE_RECORDING;
 	ChannelStreamType current_type = CHANNEL_STREAM_TYPE_NONE;
@@ -367,20 +978,21 @@ void FrontendThread::start_recording(Channel& channel,
 			{
 				g_debug("Need to change transponders to record this channel");
 
-				// Need to kill all current streams
-				ChannelStreamList::iterator iterator = streams.begin();
-				while (iterator != streams.end())
+				// Need to kill all current streams before retuning
+				if (!streams.empty())
 				{
-					ChannelStream* channel_stream = *iterator;
-					delete channel_stream;
-					iterator = streams.erase(iterator);
+					removed_streams.splice(removed_streams.end(), streams);
+					publish_snapshot(removed_streams);
+					stop();
 				}
 			}
 
 			RecordingChannelStream* channel_stream = new RecordingChannelStream(
 				channel, scheduled, make_recording_filename(channel, description), description);
 			setup_dvb(*channel_stream);
+			channel_stream->start();
 			streams.push_back(channel_stream);
+			publish_snapshot(removed_streams);
 		}
 	}
 	
@@ -391,7 +1003,8 @@ void FrontendThread::start_recording(Channel& channel,
 
 void FrontendThread::stop_recording(const Channel& channel)
 {
-	stop();
+	Glib::RecMutex::Lock lock(mutex);
+	ChannelStreamList removed_streams;
 
 	ChannelStreamList::iterator iterator = streams.begin();
 
@@ -400,7 +1013,7 @@ void FrontendThread::stop_recording(const Channel& channel)
 		ChannelStream* channel_stream = *iterator;
 		if (channel_stream->channel == channel && is_recording_stream(channel_stream))
 		{
-			delete channel_stream;
+			removed_streams.push_back(channel_stream);
 			iterator = streams.erase(iterator);
 		}
 		else
@@ -409,11 +1022,110 @@ void FrontendThread::stop_recording(const Channel& channel)
 		}
 	}
 
+	if (removed_streams.empty())
+	{
+		return;
+	}
+
+	publish_snapshot(removed_streams);
+
+	if (streams.empty())
+	{
+		stop();
+	}
+}
+
+gboolean FrontendThread::is_recording_multiplex()
+{
+	Glib::RecMutex::Lock lock(mutex);
+	for (ChannelStreamList::iterator i = streams.begin(); i != streams.end(); i++)
+	{
+		if ((*i)->type == CHANNEL_STREAM_TYPE_MULTIPLEX_RECORDING)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Records the whole transport stream of the channel's transponder into one file,
+// services can be extracted from it later with a ServiceExtractor
+String FrontendThread::start_multiplex_recording(Channel& channel)
+{
+	Glib::RecMutex::Lock lock(mutex);
+
+	if (is_recording_multiplex())
+	{
+		throw Exception(_("The multiplex is already being recorded"));
+	}
+
+	if (channel.transponder != frontend.get_frontend_parameters())
+	{
+		if (!streams.empty())
+		{
+			throw Exception(_("Frontend is in use on another transponder"));
+		}
+
+		stop_epg_thread();
+		frontend.tune_to(channel.transponder);
+	}
+	start_epg_thread();
+
+	String description = _("Multiplex");
+	String filename = make_recording_filename(channel, description);
+
+	RecordingChannelStream* channel_stream = new RecordingChannelStream(
+		CHANNEL_STREAM_TYPE_MULTIPLEX_RECORDING, channel, filename, description);
+	reference_pids(*channel_stream);
+	channel_stream->start();
+	streams.push_back(channel_stream);
+
+	ChannelStreamList removed_streams;
+	publish_snapshot(removed_streams);
+
+	g_debug("Multiplex recording started (%s)", frontend.get_path().c_str());
+
 	start();
+
+	return filename;
+}
+
+void FrontendThread::stop_multiplex_recording()
+{
+	Glib::RecMutex::Lock lock(mutex);
+	ChannelStreamList removed_streams;
+
+	ChannelStreamList::iterator iterator = streams.begin();
+	while (iterator != streams.end())
+	{
+		if ((*iterator)->type == CHANNEL_STREAM_TYPE_MULTIPLEX_RECORDING)
+		{
+			removed_streams.push_back(*iterator);
+			iterator = streams.erase(iterator);
+		}
+		else
+		{
+			iterator++;
+		}
+	}
+
+	if (removed_streams.empty())
+	{
+		return;
+	}
+
+	publish_snapshot(removed_streams);
+
+	if (streams.empty())
+	{
+		stop();
+	}
 }
 
 gboolean FrontendThread::is_recording(const Channel& channel)
 {
+	Glib::RecMutex::Lock lock(mutex);
 	for (ChannelStreamList::iterator i = streams.begin(); i != streams.end(); i++)
 	{
 		ChannelStream* channel_stream = *i;
@@ -428,6 +1140,7 @@ gboolean FrontendThread::is_recording(const Channel& channel)
 
 gboolean FrontendThread::is_available(const Channel& channel)
 {
+	Glib::RecMutex::Lock lock(mutex);
 	if (!(channel.transponder == frontend.get_frontend_parameters()) && !streams.empty())
 	{
 		return false;
@@ -438,6 +1151,7 @@ gboolean FrontendThread::is_available(const Channel& channel)
 
 gboolean FrontendThread::is_broadcasting()
 {
+	Glib::RecMutex::Lock lock(mutex);
 	for (ChannelStreamList::iterator i = streams.begin(); i != streams.end(); i++)
 	{
 		ChannelStream* channel_stream = *i;
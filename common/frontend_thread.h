@@ -24,21 +24,76 @@
 #include "epg_thread.h"
 #include "channel_stream.h"
 #include "dvb_frontend.h"
+#include "psi_tracker.h"
+#include <map>
+
+#define TS_DEMUXER_BUFFER_SIZE	(TS_PACKET_SIZE * 16384)
+#define GOP_CACHE_TIMEOUT		250000 // microseconds
 
 typedef std::list<ChannelStream*> ChannelStreamList;
+typedef std::vector<ChannelStream*> ChannelStreamArray;
+
+// Immutable view of the streams read by the frontend thread, replaced as a whole
+// whenever a stream is added or removed
+class StreamSnapshot
+{
+public:
+	ChannelStreamArray				streams;
+	guint16							pid_map[PID_COUNT];
+	std::vector<ChannelStreamArray>	pid_subscribers;
+	ChannelStreamArray				all_pid_subscribers;
+	gboolean						psi_pids[PID_COUNT];
+	PsiTracker::ServiceMap			services;
+	Dvb::Transponder				transponder;
+
+	StreamSnapshot(const ChannelStreamList& streams);
+};
 
 class FrontendThread : public Thread
 {
 private:
+	class PsiUpdater : public Thread
+	{
+	private:
+		FrontendThread& frontend_thread;
+	public:
+		PsiUpdater(FrontendThread& ft) : Thread("PSI Updater"), frontend_thread(ft) {}
+		void run() { frontend_thread.run_psi_updater(); }
+	};
+
+	Glib::StaticRecMutex	mutex;
 	ChannelStreamList	streams;
+	StreamSnapshot* volatile	snapshot;
+	volatile gint		reader_generation;
 	EpgThread*			epg_thread;
-	int					dvr_fd;
+	Dvb::Demuxer*		ts_demuxer;
+	std::map<guint, guint>	pid_references;
+	PsiTracker			psi_tracker;
+	Glib::StaticMutex	section_mutex;
+	Dvb::SectionFilter	section_filter;
+	volatile gint		section_filter_count;
+	Glib::StaticMutex	psi_mutex;
+	PsiUpdateList		psi_updates;
+	PsiUpdater			psi_updater;
 	guint				timeout;
 	gboolean			ignore_teletext;
 		
 	void write(Glib::RefPtr<Glib::IOChannel> channel, guchar* buffer, gsize length);
 	void run();
 	void setup_dvb(ChannelStream& stream);
+	guint read_pmt(guint service_id, Buffer& buffer);
+	void read_section(guint pid, guint table_id, gint table_id_extension, Buffer& buffer);
+	void read_demuxer_sections(gboolean discard);
+	void prime_stream(ChannelStream& channel_stream);
+	BroadcastingChannelStream* find_broadcast(const Channel& channel);
+	void start_broadcast(BroadcastingChannelStream* channel_stream);
+	void run_psi_updater();
+	void apply_psi_update(const PsiUpdate& update);
+	void publish_snapshot(ChannelStreamList& removed_streams);
+	void reference_pid(guint pid);
+	void unreference_pid(guint pid);
+	void reference_pids(const ChannelStream& channel_stream);
+	void unreference_pids(const ChannelStream& channel_stream);
 	void start_epg_thread();
 	void stop_epg_thread();
 
@@ -55,9 +110,16 @@ public:
 	void start_recording(Channel& channel, const String& description, gboolean scheduled);
 	void stop_recording(const Channel& channel);
 
+	gboolean is_recording_multiplex();
+	String start_multiplex_recording(Channel& channel);
+	void stop_multiplex_recording();
+
 	gboolean is_broadcasting();
-	void start_broadcasting(Channel& channel, int client_id, const String& interface, const String& address, int port);
+	gboolean is_broadcasting(const Channel& channel);
+	int start_broadcasting(Channel& channel, int client_id, const String& interface, const String& address, int port, gboolean multicast, gboolean rtp);
+	void start_broadcasting(Channel& channel, int client_id, StreamSink* sink, gboolean owns_sink = false);
 	void stop_broadcasting(int client_id);
+	gboolean timeshift(int client_id, TimeshiftAction action, guint seconds);
 
 	void start();
 	void stop();
@@ -0,0 +1,495 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "http_server_thread.h"
+#include "exception.h"
+#include "common.h"
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+
+// HTTP clients are not registered clients, so they get negative client IDs
+static volatile gint next_client_id = 0;
+
+HttpServerThread::HttpServerThread(guint port) : Thread("HTTP Server")
+{
+	g_message("Starting HTTP service on port %d", port);
+
+	// A client closing its connection must not take the server down
+	signal(SIGPIPE, SIG_IGN);
+
+	socket_server = socket(AF_INET, SOCK_STREAM, 0);
+	if (socket_server < 0)
+	{
+		throw SystemException("Failed to open socket");
+	}
+
+	int reuse = 1;
+	setsockopt(socket_server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	struct sockaddr_in server_address;
+	memset(&server_address, 0, sizeof(server_address));
+	server_address.sin_family = AF_INET;
+	server_address.sin_addr.s_addr = INADDR_ANY;
+	server_address.sin_port = htons(port);
+	if (bind(socket_server, (struct sockaddr*)&server_address, sizeof(server_address)) < 0)
+	{
+		::close(socket_server);
+		throw SystemException("Failed to bind");
+	}
+
+	listen(socket_server, 16);
+}
+
+HttpServerThread::~HttpServerThread()
+{
+	join(true);
+	reap_connections(true);
+	::close(socket_server);
+}
+
+void HttpServerThread::reap_connections(gboolean all)
+{
+	ConnectionList::iterator i = connections.begin();
+	while (i != connections.end())
+	{
+		Connection* connection = *i;
+		if (all || connection->is_finished())
+		{
+			delete connection;
+			i = connections.erase(i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+void HttpServerThread::run()
+{
+	struct pollfd pfds[1];
+	pfds[0].fd = socket_server;
+	pfds[0].events = POLLIN;
+
+	while (!is_terminated())
+	{
+		reap_connections(false);
+
+		if (::poll(pfds, 1, 1000) <= 0)
+		{
+			continue;
+		}
+
+		int socket_client = accept(socket_server, NULL, NULL);
+		if (socket_client < 0)
+		{
+			continue;
+		}
+
+		if (connections.size() >= HTTP_MAX_CONNECTIONS)
+		{
+			g_message("Too many HTTP connections, refusing another");
+			const gchar* response = "HTTP/1.1 503 Service Unavailable\r\nServer: Me TV\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+			::send(socket_client, response, strlen(response), MSG_DONTWAIT | MSG_NOSIGNAL);
+			::close(socket_client);
+			continue;
+		}
+
+		Connection* connection = new Connection(socket_client);
+		connections.push_back(connection);
+		try
+		{
+			connection->start();
+		}
+		catch(...)
+		{
+			g_message("Failed to start HTTP connection");
+			connections.pop_back();
+			delete connection;
+		}
+	}
+}
+
+HttpServerThread::Connection::Connection(int s) : Thread("HTTP Connection"), sd(s), finished(false)
+{
+	struct timeval timeout;
+	timeout.tv_sec = HTTP_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+HttpServerThread::Connection::~Connection()
+{
+	join(true);
+	::close(sd);
+}
+
+// Reads the request header, keeping the request line and any Range header
+gboolean HttpServerThread::Connection::read_request(String& request_line, String& range)
+{
+	std::string request;
+	gchar buffer[1024];
+
+	while (request.find("\r\n\r\n") == std::string::npos)
+	{
+		if (request.size() > HTTP_MAX_REQUEST_SIZE)
+		{
+			return false;
+		}
+
+		gssize result = ::recv(sd, buffer, sizeof(buffer), 0);
+		if (result <= 0)
+		{
+			return false;
+		}
+		request.append(buffer, result);
+	}
+
+	std::string::size_type end = request.find("\r\n");
+	request_line = request.substr(0, end);
+
+	while (end != std::string::npos && end + 2 < request.size())
+	{
+		std::string::size_type start = end + 2;
+		end = request.find("\r\n", start);
+		std::string header = request.substr(start, end - start);
+
+		if (g_ascii_strncasecmp(header.c_str(), "Range:", 6) == 0)
+		{
+			range = trim_string(header.substr(6));
+		}
+	}
+
+	return true;
+}
+
+gboolean HttpServerThread::Connection::send_all(const struct iovec* iovecs, guint count)
+{
+	std::vector<struct iovec> remaining(iovecs, iovecs + count);
+
+	guint index = 0;
+	while (index < count)
+	{
+		gssize result = ::writev(sd, &remaining[index], count - index);
+		if (result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+
+		while (index < count && (gsize)result >= remaining[index].iov_len)
+		{
+			result -= remaining[index].iov_len;
+			index++;
+		}
+
+		if (index < count)
+		{
+			remaining[index].iov_base = (guchar*)remaining[index].iov_base + result;
+			remaining[index].iov_len -= result;
+		}
+	}
+
+	return true;
+}
+
+void HttpServerThread::Connection::send_headers(const String& status, const String& headers)
+{
+	String response = String::compose("HTTP/1.1 %1\r\nServer: Me TV\r\nConnection: close\r\n%2\r\n", status, headers);
+
+	struct iovec iovec;
+	iovec.iov_base = (void*)response.c_str();
+	iovec.iov_len = response.bytes();
+	if (!send_all(&iovec, 1))
+	{
+		throw SystemException("Failed to send HTTP response");
+	}
+}
+
+void HttpServerThread::Connection::send_error(const String& status)
+{
+	send_headers(status, "Content-Length: 0\r\n");
+}
+
+void HttpServerThread::Connection::run()
+{
+	try
+	{
+		String request_line;
+		String range;
+
+		if (read_request(request_line, range))
+		{
+			std::vector<String> parts;
+			String::size_type start = 0;
+			while (parts.size() < 3 && start <= request_line.size())
+			{
+				String::size_type end = request_line.find(' ', start);
+				parts.push_back(request_line.substr(start, end == String::npos ? String::npos : end - start));
+				start = end == String::npos ? request_line.size() + 1 : end + 1;
+			}
+
+			g_debug("HTTP request '%s'", request_line.c_str());
+
+			if (parts.size() != 3)
+			{
+				send_error("400 Bad Request");
+			}
+			else if (parts[0] != "GET")
+			{
+				send_error("405 Method Not Allowed");
+			}
+			else if (parts[1].compare(0, 6, "/live/") == 0)
+			{
+				serve_live(::atoi(parts[1].substr(6).c_str()), parts[2] == "HTTP/1.1");
+			}
+			else if (parts[1].compare(0, 12, "/recordings/") == 0)
+			{
+				gchar* filename = g_uri_unescape_string(parts[1].substr(12).c_str(), NULL);
+				String name = filename == NULL ? "" : filename;
+				g_free(filename);
+				serve_recording(name, range);
+			}
+			else
+			{
+				send_error("404 Not Found");
+			}
+		}
+	}
+	catch(const Exception& exception)
+	{
+		g_debug("HTTP connection failed: %s", exception.what().c_str());
+	}
+	catch(...)
+	{
+		g_debug("HTTP connection failed");
+	}
+
+	g_atomic_int_set(&finished, true);
+}
+
+// Streams a channel until the client goes away, falls too far behind or the
+// broadcast stops sending data
+void HttpServerThread::Connection::serve_live(int channel_id, gboolean chunked)
+{
+	Channel channel;
+	try
+	{
+		channel = ChannelManager::get(channel_id);
+	}
+	catch(...)
+	{
+		send_error("404 Not Found");
+		return;
+	}
+
+	int client_id = -1 - g_atomic_int_exchange_and_add(&next_client_id, 1);
+	BufferedStreamSink sink;
+
+	try
+	{
+		stream_manager.start_broadcasting(channel, client_id, &sink);
+	}
+	catch(...)
+	{
+		send_error("503 Service Unavailable");
+		return;
+	}
+
+	try
+	{
+		send_headers("200 OK", String::compose("Content-Type: video/mp2t\r\nCache-Control: no-cache\r\n%1",
+			chunked ? "Transfer-Encoding: chunked\r\n" : ""));
+
+		std::vector<guchar> data;
+		gint64 last_data = g_get_monotonic_time();
+		gboolean connected = true;
+
+		while (connected && !is_terminated() && !sink.is_overflowed())
+		{
+			sink.read(data);
+			if (data.empty())
+			{
+				if (g_get_monotonic_time() - last_data > HTTP_TIMEOUT * G_USEC_PER_SEC)
+				{
+					g_debug("HTTP client %d timed out waiting for data", client_id);
+					break;
+				}
+				usleep(10000);
+				continue;
+			}
+			last_data = g_get_monotonic_time();
+
+			gchar chunk_header[32];
+			struct iovec iovecs[3];
+			guint count = 0;
+
+			if (chunked)
+			{
+				iovecs[count].iov_base = chunk_header;
+				iovecs[count++].iov_len = g_snprintf(chunk_header, sizeof(chunk_header), "%x\r\n", (guint)data.size());
+			}
+			iovecs[count].iov_base = &data[0];
+			iovecs[count++].iov_len = data.size();
+			if (chunked)
+			{
+				iovecs[count].iov_base = (void*)"\r\n";
+				iovecs[count++].iov_len = 2;
+			}
+
+			connected = send_all(iovecs, count);
+		}
+
+		if (sink.is_overflowed())
+		{
+			g_message("HTTP client %d fell too far behind, disconnecting", client_id);
+		}
+
+		if (connected && chunked)
+		{
+			struct iovec iovec;
+			iovec.iov_base = (void*)"0\r\n\r\n";
+			iovec.iov_len = 5;
+			send_all(&iovec, 1);
+		}
+	}
+	catch(...)
+	{
+		stream_manager.stop_broadcasting(client_id);
+		throw;
+	}
+
+	stream_manager.stop_broadcasting(client_id);
+}
+
+// Only plain file names inside the recording directory are served.  A single
+// byte range is supported, other Range headers get the whole file.
+void HttpServerThread::Connection::serve_recording(const String& filename, const String& range)
+{
+	if (filename.empty() || filename[0] == '.' || filename.find('/') != String::npos)
+	{
+		send_error("404 Not Found");
+		return;
+	}
+
+	String path = Glib::build_filename(recording_directory, filename);
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		send_error("404 Not Found");
+		return;
+	}
+
+	try
+	{
+		struct stat status;
+		if (fstat(fd, &status) < 0 || !S_ISREG(status.st_mode))
+		{
+			throw SystemException("Failed to get recording size");
+		}
+
+		guint64 size = status.st_size;
+		guint64 start = 0;
+		guint64 end = size;
+		gboolean partial = false;
+
+		if (range.compare(0, 6, "bytes=") == 0 && range.find(',') == String::npos)
+		{
+			String spec = range.substr(6);
+			String::size_type dash = spec.find('-');
+			if (dash != String::npos)
+			{
+				String first = spec.substr(0, dash);
+				String last = spec.substr(dash + 1);
+
+				partial = true;
+				if (first.empty())
+				{
+					guint64 suffix = g_ascii_strtoull(last.c_str(), NULL, 10);
+					start = suffix < size ? size - suffix : 0;
+				}
+				else
+				{
+					start = g_ascii_strtoull(first.c_str(), NULL, 10);
+					if (!last.empty())
+					{
+						end = MIN(g_ascii_strtoull(last.c_str(), NULL, 10) + 1, size);
+					}
+				}
+			}
+		}
+
+		if (partial && start >= end)
+		{
+			send_headers("416 Range Not Satisfiable", String::compose("Content-Range: bytes */%1\r\nContent-Length: 0\r\n", size));
+			::close(fd);
+			return;
+		}
+
+		String headers;
+		if (path.size() > 5 && path.substr(path.size() - 5) == ".m3u8")
+		{
+			// Playlists of segmented recordings change until the recording ends
+			headers = "Content-Type: application/vnd.apple.mpegurl\r\nCache-Control: no-cache\r\n";
+		}
+		else
+		{
+			headers = "Content-Type: video/mp2t\r\n";
+		}
+
+		headers += String::compose("Accept-Ranges: bytes\r\nContent-Length: %1\r\n", end - start);
+		if (partial)
+		{
+			headers += String::compose("Content-Range: bytes %1-%2/%3\r\n", start, end - 1, size);
+		}
+		send_headers(partial ? "206 Partial Content" : "200 OK", headers);
+
+		off_t offset = start;
+		while ((guint64)offset < end && !is_terminated())
+		{
+			gssize result = ::sendfile(sd, fd, &offset, MIN(end - offset, (guint64)HTTP_SENDFILE_SIZE));
+			if (result <= 0)
+			{
+				if (result < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				break;
+			}
+		}
+	}
+	catch(...)
+	{
+		::close(fd);
+		throw;
+	}
+
+	::close(fd);
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __HTTP_SERVER_THREAD_H__
+#define __HTTP_SERVER_THREAD_H__
+
+#include "thread.h"
+#include "stream_sink.h"
+#include <list>
+
+#define HTTP_MAX_REQUEST_SIZE	8192
+#define HTTP_TIMEOUT			10 // seconds
+#define HTTP_SENDFILE_SIZE		(1024 * 1024)
+#define HTTP_MAX_CONNECTIONS	16
+
+// Serves live channels as chunked MPEG-TS from the shared broadcast streams
+// (GET /live/<channel_id>) and recordings with byte ranges through sendfile()
+// (GET /recordings/<filename>).  Each connection gets a thread of its own, up to
+// HTTP_MAX_CONNECTIONS, after which connections are turned away.
+class HttpServerThread : public Thread
+{
+private:
+	class Connection : public Thread
+	{
+	private:
+		int				sd;
+		volatile gint	finished;
+
+		gboolean read_request(String& request_line, String& range);
+		void send_headers(const String& status, const String& headers);
+		void send_error(const String& status);
+		gboolean send_all(const struct iovec* iovecs, guint count);
+		void serve_live(int channel_id, gboolean chunked);
+		void serve_recording(const String& filename, const String& range);
+
+	public:
+		Connection(int sd);
+		~Connection();
+
+		void run();
+		gboolean is_finished() { return g_atomic_int_get(&finished); }
+	};
+	typedef std::list<Connection*> ConnectionList;
+
+	int				socket_server;
+	ConnectionList	connections;
+
+	void reap_connections(gboolean all);
+
+protected:
+	void run();
+
+public:
+	HttpServerThread(guint port);
+	~HttpServerThread();
+};
+
+#endif
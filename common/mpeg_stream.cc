@@ -19,6 +19,7 @@
  */
 
 #include <glibmm.h>
+#include <algorithm>
 #include "mpeg_stream.h"
 #include "exception.h"
 #include "common.h"
@@ -28,9 +29,9 @@ Mpeg::Stream::Stream()
 {
 	g_debug("Creating MPEG stream");
 	pmt_pid = 0;
+	output_pmt_pid = 0;
 	pcr_pid = 0;
-	pat_counter = 0;
-	pmt_counter = 0;
+	version = 1;
 }
 
 Mpeg::Stream::~Stream()
@@ -40,6 +41,7 @@ Mpeg::Stream::~Stream()
 
 void Mpeg::Stream::clear()
 {
+	version++;
 	video_streams.clear();
 	audio_streams.clear();
 	subtitle_streams.clear();
@@ -89,7 +91,7 @@ void Mpeg::Stream::build_pat(guchar* buffer)
 	buffer[0x00] = 0x47;
 	buffer[0x01] = 0x40;
 	buffer[0x02] = 0x00; // PID = 0x0000
-	buffer[0x03] = 0x10 | (pat_counter++ & 0x0f);
+	buffer[0x03] = 0x10; // continuity counter is set by the caller
 	buffer[0x04] = 0x00; // CRC calculation begins here
 	buffer[0x05] = 0x00; // 0x00: Program association section
 	buffer[0x06] = 0xb0;
@@ -104,17 +106,17 @@ void Mpeg::Stream::build_pat(guchar* buffer)
 	buffer[0x0f] = 0xe0;
 	buffer[0x10] = 0x10;
 	
-	// Program Map PID
-	pmt_pid = 0xff;
-	while (is_pid_used(pmt_pid))
+	// Program Map PID, kept separate from the PMT PID of the source mux
+	output_pmt_pid = 0xff;
+	while (is_pid_used(output_pmt_pid))
 	{
-		pmt_pid--;
+		output_pmt_pid--;
 	}
 	
 	buffer[0x11] = 0x03;
 	buffer[0x12] = 0xe8;
 	buffer[0x13] = 0xe0;
-	buffer[0x14] = pmt_pid;
+	buffer[0x14] = output_pmt_pid;
 	
 	// Put CRC in buffer[0x15...0x18]
 	guint crc32 = Crc32::calculate( (guchar*)buffer + 0x05, (guchar*)buffer + 0x15 );
@@ -144,8 +146,8 @@ void Mpeg::Stream::build_pmt(guchar* buffer)
 
 	buffer[0x00] = 0x47;
 	buffer[0x01] = 0x40;
-	buffer[0x02] = pmt_pid;
-	buffer[0x03] = 0x10 | (pmt_counter++ & 0xf);
+	buffer[0x02] = output_pmt_pid;
+	buffer[0x03] = 0x10; // continuity counter is set by the caller
 	buffer[0x04] = 0x00; // CRC calculation begins here
 	buffer[0x05] = 0x02; // 0x02: Program map section
 	buffer[0x06] = 0xb0;
@@ -298,9 +300,9 @@ void Mpeg::Stream::set_pmt_pid(const Buffer& buffer, guint service_id)
 	g_debug("Searching for service ID %d", service_id);
 	while (offset < (section_length - 4))
 	{
-		guint current_program_number = buffer.get_bits(offset, 0, 16);
+		guint current_program_number = buffer.get_bits<0, 16>(offset);
 		offset += 2;
-		guint current_program_map_pid = buffer.get_bits(offset, 3, 13);
+		guint current_program_map_pid = buffer.get_bits<3, 13>(offset);
 		offset += 2;
 
 		g_debug("%d: Service ID: %d, PMT ID: %d", ++i, current_program_number, current_program_map_pid);
@@ -416,9 +418,9 @@ void Mpeg::Stream::parse_pms(const Buffer& buffer, gboolean ignore_teletext)
 						TeletextLanguageDescriptor descriptor;
 						
 						descriptor.language			= get_lang_desc(desc + descriptor_index);
-						descriptor.type				= buffer.get_bits(descriptor_offset + descriptor_index + 6, 0, 5);
-						descriptor.magazine_number	= buffer.get_bits(descriptor_offset + descriptor_index + 6, 5, 3);
-						descriptor.page_number		= buffer.get_bits(descriptor_offset + descriptor_index + 7, 0, 8);
+						descriptor.type				= buffer.get_bits<0, 5>(descriptor_offset + descriptor_index + 6);
+						descriptor.magazine_number	= buffer.get_bits<5, 3>(descriptor_offset + descriptor_index + 6);
+						descriptor.page_number		= buffer.get_bits<0, 8>(descriptor_offset + descriptor_index + 7);
 						
 						g_debug("TeleText: Language: '%s', Type: %d, Magazine Number: %d, Page Number: %d",
 							descriptor.language.c_str(),
@@ -446,12 +448,12 @@ void Mpeg::Stream::parse_pms(const Buffer& buffer, gboolean ignore_teletext)
 					gint descriptor_offest = desc - buffer.get_buffer();
 					if (descriptor_length > 0)
 					{
-						stream.subtitling_type = buffer.get_bits(descriptor_offest + 5, 0, 8);
+						stream.subtitling_type = buffer.get_bits<0, 8>(descriptor_offest + 5);
 						if (stream.subtitling_type>=0x10 && stream.subtitling_type<=0x23)
 						{
 							stream.language				= get_lang_desc(desc);
-							stream.composition_page_id	= buffer.get_bits(descriptor_offest + 6, 0, 16);
-							stream.ancillary_page_id	= buffer.get_bits(descriptor_offest + 8, 0, 16);
+							stream.composition_page_id	= buffer.get_bits<0, 16>(descriptor_offest + 6);
+							stream.ancillary_page_id	= buffer.get_bits<0, 16>(descriptor_offest + 8);
 							
 							g_debug(
 								"Subtitle composition_page_id: %d, ancillary_page_id: %d, language: %s",
@@ -540,3 +542,148 @@ gboolean Mpeg::Stream::contains_pid(guint pid)
 
 	return false;
 }
+
+static void add_pid(std::vector<guint>& pids, guint pid)
+{
+	if (std::find(pids.begin(), pids.end(), pid) == pids.end())
+	{
+		pids.push_back(pid);
+	}
+}
+
+std::vector<guint> Mpeg::Stream::get_pids() const
+{
+	std::vector<guint> pids;
+
+	if (pcr_pid != NULL_PID)
+	{
+		add_pid(pids, pcr_pid);
+	}
+
+	for (guint index = 0; index < video_streams.size(); index++)
+	{
+		add_pid(pids, video_streams[index].pid);
+	}
+
+	for (guint index = 0; index < audio_streams.size(); index++)
+	{
+		add_pid(pids, audio_streams[index].pid);
+	}
+
+	for (guint index = 0; index < subtitle_streams.size(); index++)
+	{
+		add_pid(pids, subtitle_streams[index].pid);
+	}
+
+	for (guint index = 0; index < teletext_streams.size(); index++)
+	{
+		add_pid(pids, teletext_streams[index].pid);
+	}
+
+	return pids;
+}
+
+guint Mpeg::get_pid(const guchar* packet)
+{
+	return ((packet[1] & 0x1f) << 8) + packet[2];
+}
+
+// Returns the start of the packet payload, or NULL if there is none
+static const guchar* get_payload(const guchar* packet)
+{
+	guint adaptation_field_control = (packet[3] >> 4) & 0x03;
+	const guchar* payload = packet + 4;
+
+	if ((adaptation_field_control & 0x01) == 0)
+	{
+		return NULL;
+	}
+
+	if (adaptation_field_control & 0x02)
+	{
+		payload += packet[4] + 1;
+	}
+
+	return payload < packet + TS_PACKET_SIZE ? payload : NULL;
+}
+
+gboolean Mpeg::get_pts(const guchar* packet, guint64& pts)
+{
+	const guchar* payload = get_payload(packet);
+	if ((packet[1] & 0x40) == 0 || payload == NULL || payload + 14 > packet + TS_PACKET_SIZE)
+	{
+		return false;
+	}
+
+	// PES start code and PTS_DTS_flags
+	if (payload[0] != 0x00 || payload[1] != 0x00 || payload[2] != 0x01 || (payload[7] & 0x80) == 0)
+	{
+		return false;
+	}
+
+	pts = ((guint64)(payload[9] & 0x0e) << 29) | (payload[10] << 22) | ((payload[11] & 0xfe) << 14) |
+		(payload[12] << 7) | (payload[13] >> 1);
+
+	return true;
+}
+
+// The 90kHz base of the PCR carried in the adaptation field
+gboolean Mpeg::get_pcr(const guchar* packet, guint64& pcr)
+{
+	if ((packet[3] & 0x20) == 0 || packet[4] < 7 || (packet[5] & 0x10) == 0)
+	{
+		return false;
+	}
+
+	pcr = ((guint64)packet[6] << 25) | (packet[7] << 17) | (packet[8] << 9) | (packet[9] << 1) | (packet[10] >> 7);
+
+	return true;
+}
+
+// True for a packet that a decoder can start from: the random access indicator is
+// set, or the PES that starts in it begins with an MPEG-2 I picture / sequence
+// header or an H.264 IDR slice / SPS
+gboolean Mpeg::is_random_access(const guchar* packet, guint stream_type)
+{
+	if ((packet[3] & 0x20) && packet[4] > 0 && (packet[5] & 0x40))
+	{
+		return true;
+	}
+
+	const guchar* payload = get_payload(packet);
+	if ((packet[1] & 0x40) == 0 || payload == NULL || payload + 9 > packet + TS_PACKET_SIZE)
+	{
+		return false;
+	}
+
+	const guchar* data = payload + 9 + payload[8];
+	const guchar* end = packet + TS_PACKET_SIZE;
+
+	for (; data + 5 < end; data++)
+	{
+		if (data[0] != 0x00 || data[1] != 0x00 || data[2] != 0x01)
+		{
+			continue;
+		}
+
+		if (stream_type == STREAM_TYPE_H264)
+		{
+			guint nal_unit_type = data[3] & 0x1f;
+			if (nal_unit_type == 5 || nal_unit_type == 7)
+			{
+				return true;
+			}
+		}
+		else if (data[3] == 0xb3)
+		{
+			return true;
+		}
+		else if (data[3] == 0x00)
+		{
+			// Picture header, picture_coding_type 1 is an I picture
+			return ((data[5] >> 3) & 0x07) == 1;
+		}
+	}
+
+	return false;
+}
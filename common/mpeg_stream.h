@@ -29,6 +29,12 @@
 #define STREAM_TYPE_VIDEO		0x80
 #define STREAM_TYPE_AUDIO_AC3	0x81
 
+#define TS_PACKET_SIZE			188
+#define PACKET_BUFFER_SIZE		50
+
+#define PID_COUNT				0x2000
+#define NULL_PID				0x1FFF
+
 #include <linux/dvb/frontend.h>
 #include "me-tv-types.h"
 #include "i18n.h"
@@ -113,13 +119,13 @@ namespace Mpeg
 	{
 	private:
 		guint pmt_pid;
+		guint output_pmt_pid;
 		guint pcr_pid;
 
 		gboolean is_pid_used(guint pid);
 		gboolean find_descriptor(guchar tag, const unsigned char *buf, int descriptors_loop_len, const unsigned char **desc, int *desc_len);
 		String get_lang_desc(const guchar* buffer);
-		guint pat_counter;
-		guint pmt_counter;
+		guint version;
 			
 	public:
 		Stream();
@@ -132,14 +138,22 @@ namespace Mpeg
 
 		guint get_pcr_pid() const { return pcr_pid; }
 		guint get_pmt_pid() const { return pmt_pid; }
+		guint get_version() const { return version; }
 		void set_pmt_pid(const Buffer& buffer, guint service_id);
+		void set_pmt_pid(guint pid) { pmt_pid = pid; }
 		void parse_pms(const Buffer& buffer, gboolean ignore_teletext);
 		void build_pat(guchar* buffer);
 		void build_pmt(guchar* buffer);
 		gboolean contains_pid(guint pid);
+		std::vector<guint> get_pids() const;
 
 		void clear();
 	};
+
+	guint get_pid(const guchar* packet);
+	gboolean get_pts(const guchar* packet, guint64& pts);
+	gboolean get_pcr(const guchar* packet, guint64& pcr);
+	gboolean is_random_access(const guchar* packet, guint stream_type);
 }
 
 #endif
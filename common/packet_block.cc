@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "packet_block.h"
+
+static Glib::StaticMutex			pool_mutex = GLIBMM_STATIC_MUTEX_INIT;
+static std::vector<PacketBlock*>	free_blocks;
+
+PacketBlock* PacketBlock::acquire()
+{
+	PacketBlock* block = NULL;
+
+	{
+		Glib::Mutex::Lock lock(pool_mutex);
+		if (!free_blocks.empty())
+		{
+			block = free_blocks.back();
+			free_blocks.pop_back();
+		}
+	}
+
+	if (block == NULL)
+	{
+		block = new PacketBlock();
+	}
+
+	block->length = 0;
+	block->reference_count = 1;
+
+	return block;
+}
+
+void PacketBlock::unreference()
+{
+	if (g_atomic_int_dec_and_test(&reference_count))
+	{
+		Glib::Mutex::Lock lock(pool_mutex);
+		free_blocks.push_back(this);
+	}
+}
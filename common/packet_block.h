@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __PACKET_BLOCK_H__
+#define __PACKET_BLOCK_H__
+
+#include "mpeg_stream.h"
+
+// A reference counted block of TS packets as read from the DVR device.  Blocks
+// are pooled, the last unreference() puts the block back into the pool.
+class PacketBlock
+{
+private:
+	volatile gint reference_count;
+
+	PacketBlock() : reference_count(0), length(0), sequence(0) {}
+
+public:
+	guchar	data[TS_PACKET_SIZE * PACKET_BUFFER_SIZE];
+	gsize	length;
+	guint64	sequence;
+
+	static PacketBlock* acquire();
+
+	void reference() { g_atomic_int_inc(&reference_count); }
+	void unreference();
+};
+
+// A run of consecutive packets inside a block.  The slice owns one reference
+// to the block while it is queued.
+class PacketSlice
+{
+public:
+	PacketSlice() : block(NULL), offset(0), length(0) {}
+	PacketSlice(PacketBlock* b, guint o, guint l) : block(b), offset(o), length(l) {}
+
+	PacketBlock*	block;
+	guint			offset;
+	guint			length;
+
+	guchar* get_data() const { return block->data + offset; }
+
+	// Position of the first packet in the frontend's input, in packets
+	guint64 get_position() const { return block->sequence * PACKET_BUFFER_SIZE + offset / TS_PACKET_SIZE; }
+};
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "pmt_cache.h"
+#include "data.h"
+#include "common.h"
+#include <string.h>
+
+Glib::StaticMutex PmtCache::mutex = GLIBMM_STATIC_MUTEX_INIT;
+PmtCache::EntryMap PmtCache::entries;
+gboolean PmtCache::loaded = false;
+
+PmtCache::Key::Key(guint t, guint f, guint p, guint s, guint id) :
+	frontend_type(t), frequency(f), polarisation(p), satellite_number(s), service_id(id)
+{
+}
+
+PmtCache::Key::Key(const Dvb::Transponder& transponder, guint id) :
+	frontend_type(transponder.frontend_type), frequency(transponder.frontend_parameters.frequency),
+	polarisation(transponder.polarisation), satellite_number(transponder.satellite_number), service_id(id)
+{
+}
+
+bool PmtCache::Key::operator<(const Key& key) const
+{
+	if (frontend_type != key.frontend_type) return frontend_type < key.frontend_type;
+	if (frequency != key.frequency) return frequency < key.frequency;
+	if (polarisation != key.polarisation) return polarisation < key.polarisation;
+	if (satellite_number != key.satellite_number) return satellite_number < key.satellite_number;
+	return service_id < key.service_id;
+}
+
+static String to_hex(const std::vector<guchar>& data)
+{
+	static const gchar digits[] = "0123456789ABCDEF";
+
+	String result;
+	for (std::vector<guchar>::const_iterator i = data.begin(); i != data.end(); i++)
+	{
+		result += digits[*i >> 4];
+		result += digits[*i & 0x0F];
+	}
+
+	return result;
+}
+
+static std::vector<guchar> from_hex(const String& text)
+{
+	std::vector<guchar> result;
+	std::string data = text.raw();
+
+	for (gsize i = 0; i + 1 < data.size(); i += 2)
+	{
+		result.push_back((g_ascii_xdigit_value(data[i]) << 4) | g_ascii_xdigit_value(data[i + 1]));
+	}
+
+	return result;
+}
+
+void PmtCache::load()
+{
+	if (loaded)
+	{
+		return;
+	}
+
+	loaded = true;
+
+	Glib::RefPtr<DataModel> model = data_connection->statement_execute_select(
+		"select * from pmt_cache");
+	Glib::RefPtr<DataModelIter> iter = model->create_iter();
+
+	while (iter->move_next())
+	{
+		Key key(
+			Data::get_int(iter, "frontend_type"),
+			Data::get_int(iter, "frequency"),
+			Data::get_int(iter, "polarisation"),
+			Data::get_int(iter, "satellite_number"),
+			Data::get_int(iter, "service_id"));
+		Entry& entry = entries[key];
+		entry.pmt_pid = Data::get_int(iter, "pmt_pid");
+		entry.section = from_hex(Data::get(iter, "section"));
+	}
+
+	g_debug("Loaded %u cached PMTs", (guint)entries.size());
+}
+
+gboolean PmtCache::find(const Dvb::Transponder& transponder, guint service_id, guint& pmt_pid, Buffer& section)
+{
+	Glib::Mutex::Lock lock(mutex);
+
+	load();
+
+	EntryMap::iterator i = entries.find(Key(transponder, service_id));
+	if (i == entries.end() || i->second.section.empty())
+	{
+		return false;
+	}
+
+	pmt_pid = i->second.pmt_pid;
+	section.set_length(i->second.section.size());
+	memcpy(section.get_buffer(), &i->second.section[0], i->second.section.size());
+
+	return true;
+}
+
+// Returns true if the entry was new or has changed
+gboolean PmtCache::store(const Dvb::Transponder& transponder, guint service_id, guint pmt_pid, const Buffer& section)
+{
+	Glib::Mutex::Lock lock(mutex);
+
+	load();
+
+	std::vector<guchar> data(section.get_buffer(), section.get_buffer() + section.get_length());
+
+	Key key(transponder, service_id);
+	Entry& entry = entries[key];
+	if (entry.pmt_pid == pmt_pid && entry.section == data)
+	{
+		return false;
+	}
+
+	entry.pmt_pid = pmt_pid;
+	entry.section = data;
+
+	data_connection->statement_execute_non_select(String::compose(
+		"insert or replace into pmt_cache (frontend_type, frequency, polarisation, satellite_number, service_id, pmt_pid, section) "
+		"values (%1, %2, %3, %4, %5, %6, '%7')",
+		key.frontend_type, key.frequency, key.polarisation, key.satellite_number, service_id, pmt_pid, to_hex(data)));
+
+	g_debug("Cached PMT for service %d on %d", service_id, key.frequency);
+
+	return true;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __PMT_CACHE_H__
+#define __PMT_CACHE_H__
+
+#include "buffer.h"
+#include "dvb_transponder.h"
+#include "me-tv-types.h"
+#include <map>
+
+// Remembers the PMT PID and PMT section of each service so that a channel can be
+// started without waiting for the PAT and PMT to come around on the mux.  Entries
+// are kept per multiplex, see Dvb::Transponder::is_same_multiplex().
+class PmtCache
+{
+private:
+	class Key
+	{
+	public:
+		Key(guint frontend_type, guint frequency, guint polarisation, guint satellite_number, guint service_id);
+		Key(const Dvb::Transponder& transponder, guint service_id);
+
+		guint	frontend_type;
+		guint	frequency;
+		guint	polarisation;
+		guint	satellite_number;
+		guint	service_id;
+
+		bool operator<(const Key& key) const;
+	};
+
+	class Entry
+	{
+	public:
+		Entry() : pmt_pid(0) {}
+
+		guint				pmt_pid;
+		std::vector<guchar>	section;
+	};
+
+	typedef std::map<Key, Entry> EntryMap;
+
+	static Glib::StaticMutex	mutex;
+	static EntryMap				entries;
+	static gboolean				loaded;
+
+	static void load();
+
+public:
+	static gboolean find(const Dvb::Transponder& transponder, guint service_id, guint& pmt_pid, Buffer& section);
+	static gboolean store(const Dvb::Transponder& transponder, guint service_id, guint pmt_pid, const Buffer& section);
+};
+
+#endif
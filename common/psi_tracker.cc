@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "psi_tracker.h"
+#include "dvb_si.h"
+
+PsiTracker::PsiTracker()
+{
+	transponder = NULL;
+	services = NULL;
+	updates = NULL;
+
+	section_filter.add(PAT_PID, PAT_ID, 0xFF, false, sigc::mem_fun(*this, &PsiTracker::on_section));
+	section_filter.add(SECTION_FILTER_ANY_PID, PMT_ID, 0xFF, false, sigc::mem_fun(*this, &PsiTracker::on_section));
+}
+
+// Forgets the versions that have been reported, so the next PAT/PMT seen for each
+// service is reported again
+void PsiTracker::reset()
+{
+	pmt_versions.clear();
+	pmt_pids.clear();
+}
+
+void PsiTracker::push(const guchar* packet, const Dvb::Transponder& t, const ServiceMap& s, PsiUpdateList& u)
+{
+	transponder = &t;
+	services = &s;
+	updates = &u;
+
+	section_filter.push(packet);
+}
+
+// The section filter has already checked the CRC and dropped sections that are
+// not yet current
+void PsiTracker::on_section(guint pid, const Buffer& section)
+{
+	gsize length = section.get_length();
+
+	if (length < 12)
+	{
+		return;
+	}
+
+	if (pid == PAT_PID && section[0] == PAT_ID)
+	{
+		for (gsize offset = 8; offset + 4 <= length - 4; offset += 4)
+		{
+			guint service_id = (section[offset] << 8) | section[offset + 1];
+			guint pmt_pid = ((section[offset + 2] & 0x1f) << 8) | section[offset + 3];
+
+			ServiceMap::const_iterator service = services->find(service_id);
+			if (service == services->end() || service->second == pmt_pid)
+			{
+				continue;
+			}
+
+			ServiceMap::iterator reported = pmt_pids.find(service_id);
+			if (reported == pmt_pids.end() || reported->second != pmt_pid)
+			{
+				pmt_pids[service_id] = pmt_pid;
+
+				PsiUpdate update;
+				update.transponder = *transponder;
+				update.service_id = service_id;
+				update.pmt_pid = pmt_pid;
+				updates->push_back(update);
+			}
+		}
+	}
+	else if (section[0] == PMT_ID)
+	{
+		guint service_id = (section[3] << 8) | section[4];
+		guint version = (section[5] >> 1) & 0x1f;
+
+		ServiceMap::const_iterator service = services->find(service_id);
+		if (service == services->end() || service->second != pid)
+		{
+			return;
+		}
+
+		ServiceMap::iterator reported = pmt_versions.find(service_id);
+		if (reported == pmt_versions.end() || reported->second != version)
+		{
+			g_debug("PMT version %d seen for service %d", version, service_id);
+			pmt_versions[service_id] = version;
+
+			PsiUpdate update;
+			update.transponder = *transponder;
+			update.service_id = service_id;
+			update.pmt_pid = pid;
+			update.section.assign(section.get_buffer(), section.get_buffer() + length);
+			updates->push_back(update);
+		}
+	}
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __PSI_TRACKER_H__
+#define __PSI_TRACKER_H__
+
+#include "mpeg_stream.h"
+#include "dvb_section_filter.h"
+#include "dvb_transponder.h"
+#include <map>
+
+// A PAT or PMT change seen in the transport stream.  An empty section means that
+// the PAT has moved the service's PMT to a new PID.
+class PsiUpdate
+{
+public:
+	Dvb::Transponder	transponder;
+	guint				service_id;
+	guint				pmt_pid;
+	std::vector<guchar>	section;
+};
+
+typedef std::list<PsiUpdate> PsiUpdateList;
+
+// Follows the PAT and PMT sections in the packets read by the frontend thread and
+// reports the services whose PMT PID or PMT version has changed.  Only used by the
+// frontend thread so there is no locking.
+class PsiTracker
+{
+public:
+	// Service ID -> PMT PID
+	typedef std::map<guint, guint> ServiceMap;
+
+private:
+	Dvb::SectionFilter			section_filter;
+	std::map<guint, guint>		pmt_versions;
+	std::map<guint, guint>		pmt_pids;
+
+	// The packet being pushed
+	const Dvb::Transponder*		transponder;
+	const ServiceMap*			services;
+	PsiUpdateList*				updates;
+
+	void on_section(guint pid, const Buffer& section);
+
+public:
+	PsiTracker();
+
+	void reset();
+	void push(const guchar* packet, const Dvb::Transponder& transponder, const ServiceMap& services, PsiUpdateList& updates);
+};
+
+#endif
@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "recording_writer.h"
+#include "common.h"
+#include "exception.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+RecordingStatistics::RecordingStatistics()
+{
+	g_static_mutex_init(mutex.gobj());
+
+	bytes_written = 0;
+	write_count = 0;
+	write_time = 0;
+	max_write_time = 0;
+	start_time = g_get_monotonic_time();
+}
+
+void RecordingStatistics::add(guint64 bytes, gint64 elapsed)
+{
+	Glib::Mutex::Lock lock(mutex);
+	bytes_written += bytes;
+	write_count++;
+	write_time += elapsed;
+	max_write_time = MAX(max_write_time, elapsed);
+}
+
+String RecordingStatistics::get_text()
+{
+	Glib::Mutex::Lock lock(mutex);
+
+	gint64 elapsed = MAX(g_get_monotonic_time() - start_time, (gint64)1);
+	guint64 rate = bytes_written * 1000000 / elapsed / 1024;
+	guint64 average_latency = write_count > 0 ? write_time / write_count : 0;
+
+	return String::compose("bytes_written=\"%1\" write_rate=\"%2\" write_latency=\"%3\" write_latency_max=\"%4\"",
+		bytes_written, rate, average_latency, max_write_time);
+}
+
+RecordingWriter::RecordingWriter(const String& p, RecordingStatistics* s) : path(p)
+{
+	statistics = s != NULL ? s : &own_statistics;
+
+	buffer_index = 0;
+	buffer_length = 0;
+	buffer_written = 0;
+	flush_deadline = 0;
+	offset = 0;
+	allocated = 0;
+	unsynced = 0;
+
+	for (guint i = 0; i < RECORDING_BUFFER_COUNT; i++)
+	{
+		void* buffer = NULL;
+		if (posix_memalign(&buffer, RECORDING_BUFFER_ALIGNMENT, RECORDING_BUFFER_SIZE) != 0)
+		{
+			throw Exception(_("Failed to allocate recording buffer"));
+		}
+		buffers[i] = (guchar*)buffer;
+	}
+
+	if ((fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		for (guint i = 0; i < RECORDING_BUFFER_COUNT; i++)
+		{
+			free(buffers[i]);
+		}
+		throw SystemException(_("Failed to open recording file"));
+	}
+}
+
+RecordingWriter::~RecordingWriter()
+{
+	try
+	{
+		flush(true);
+	}
+	catch(const Glib::Exception& ex)
+	{
+		g_message("Failed to flush recording '%s': %s", path.c_str(), ex.what().c_str());
+	}
+
+	// Give back whatever was preallocated past the end of the recording
+	if (ftruncate(fd, offset) < 0)
+	{
+		g_message("Failed to truncate recording '%s'", path.c_str());
+	}
+	::close(fd);
+
+	for (guint i = 0; i < RECORDING_BUFFER_COUNT; i++)
+	{
+		free(buffers[i]);
+	}
+
+	g_debug("Recording '%s' closed: %s", path.c_str(), get_statistics().c_str());
+}
+
+void RecordingWriter::write(const guchar* data, gsize length)
+{
+	if (buffer_index == 0 && buffer_length == 0)
+	{
+		flush_deadline = g_get_monotonic_time() + RECORDING_FLUSH_TIMEOUT;
+	}
+
+	while (length > 0)
+	{
+		gsize size = MIN(length, RECORDING_BUFFER_SIZE - buffer_length);
+		memcpy(buffers[buffer_index] + buffer_length, data, size);
+		buffer_length += size;
+		data += size;
+		length -= size;
+
+		if (buffer_length == RECORDING_BUFFER_SIZE)
+		{
+			if (++buffer_index == RECORDING_BUFFER_COUNT)
+			{
+				buffer_index--;
+				write_buffers();
+			}
+			else
+			{
+				buffer_length = 0;
+			}
+		}
+	}
+}
+
+// Writes out partly filled buffers once they are RECORDING_FLUSH_TIMEOUT old, so a
+// quiet recording still reaches the disk
+gboolean RecordingWriter::flush(gboolean force)
+{
+	if (buffer_index == 0 && buffer_length == buffer_written)
+	{
+		return false;
+	}
+
+	if (force || g_get_monotonic_time() >= flush_deadline)
+	{
+		write_buffers();
+		return true;
+	}
+
+	return false;
+}
+
+// Writes every buffer up to and including buffer_index in a single pwritev()
+void RecordingWriter::write_buffers()
+{
+	guint count = buffer_index + 1;
+	gsize total = 0;
+
+	for (guint i = 0; i < count; i++)
+	{
+		gsize start = (i == 0) ? buffer_written : 0;
+		gsize end = (i == buffer_index) ? buffer_length : RECORDING_BUFFER_SIZE;
+		iovecs[i].iov_base = buffers[i] + start;
+		iovecs[i].iov_len = end - start;
+		total += end - start;
+	}
+
+	preallocate(total);
+
+	gint64 before = g_get_monotonic_time();
+	struct iovec* iovec = iovecs;
+	gsize remaining = total;
+
+	while (remaining > 0)
+	{
+		gssize result = pwritev(fd, iovec, count - (iovec - iovecs), offset);
+		if (result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			throw SystemException(_("Failed to write recording"));
+		}
+
+		offset += result;
+		remaining -= result;
+
+		while (result > 0 && (gsize)result >= iovec->iov_len)
+		{
+			result -= iovec->iov_len;
+			iovec++;
+		}
+		if (result > 0)
+		{
+			iovec->iov_base = (guchar*)iovec->iov_base + result;
+			iovec->iov_len -= result;
+		}
+	}
+
+	unsynced += total;
+	if (recording_sync_interval > 0 && unsynced >= (guint64)recording_sync_interval * 1024 * 1024)
+	{
+		fdatasync(fd);
+		unsynced = 0;
+	}
+
+	gint64 elapsed = g_get_monotonic_time() - before;
+
+	statistics->add(total, elapsed);
+
+	// A partly filled last buffer stays where it is, it is topped up and the rest
+	// of it written next time
+	if (buffer_length == RECORDING_BUFFER_SIZE)
+	{
+		buffer_length = 0;
+		buffer_written = 0;
+	}
+	else
+	{
+		if (buffer_index > 0)
+		{
+			memcpy(buffers[0], buffers[buffer_index], buffer_length);
+		}
+		buffer_written = buffer_length;
+	}
+	buffer_index = 0;
+	flush_deadline = g_get_monotonic_time() + RECORDING_FLUSH_TIMEOUT;
+}
+
+void RecordingWriter::preallocate(gsize length)
+{
+	if (offset + length <= allocated)
+	{
+		return;
+	}
+
+	guint64 size = MAX((guint64)RECORDING_PREALLOCATE_SIZE, offset + length - allocated);
+	if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocated, size) == 0)
+	{
+		allocated += size;
+	}
+	else
+	{
+		// Not supported by every file system, just carry on without it
+		allocated = G_MAXUINT64;
+	}
+}
+
+String RecordingWriter::get_statistics()
+{
+	return statistics->get_text();
+}
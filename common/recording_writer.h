@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __RECORDING_WRITER_H__
+#define __RECORDING_WRITER_H__
+
+#include "me-tv-types.h"
+#include <sys/uio.h>
+
+#define RECORDING_BUFFER_SIZE		(512 * 1024)
+#define RECORDING_BUFFER_COUNT		8
+#define RECORDING_BUFFER_ALIGNMENT	4096
+#define RECORDING_PREALLOCATE_SIZE	(64 * 1024 * 1024)
+#define RECORDING_FLUSH_TIMEOUT		1000000 // microseconds
+
+// Write rates and latencies, shared by the writers of a segmented recording so
+// that they cover the whole recording.  Read from other threads.
+class RecordingStatistics
+{
+private:
+	Glib::StaticMutex	mutex;
+	guint64				bytes_written;
+	guint64				write_count;
+	gint64				write_time;
+	gint64				max_write_time;
+	gint64				start_time;
+
+public:
+	RecordingStatistics();
+
+	void add(guint64 bytes, gint64 elapsed);
+	String get_text();
+};
+
+// Writes a recording through a set of large aligned buffers which are written
+// together with pwritev(), preallocating the file ahead of the data with fallocate()
+class RecordingWriter
+{
+private:
+	int				fd;
+	String			path;
+	guchar*			buffers[RECORDING_BUFFER_COUNT];
+	struct iovec	iovecs[RECORDING_BUFFER_COUNT];
+	guint			buffer_index;
+	gsize			buffer_length;
+	gsize			buffer_written;
+	gint64			flush_deadline;
+	guint64			offset;
+	guint64			allocated;
+	guint64			unsynced;
+
+	RecordingStatistics		own_statistics;
+	RecordingStatistics*	statistics;
+
+	void write_buffers();
+	void preallocate(gsize length);
+
+public:
+	RecordingWriter(const String& path, RecordingStatistics* statistics = NULL);
+	~RecordingWriter();
+
+	void write(const guchar* data, gsize length);
+	gboolean flush(gboolean force = false);
+
+	// File offset of the next byte passed to write()
+	guint64 get_position() const { return offset + buffer_index * RECORDING_BUFFER_SIZE + buffer_length - buffer_written; }
+
+	String get_statistics();
+};
+
+#endif
@@ -23,6 +23,9 @@
 #include "epg_events.h"
 #include "common.h"
 #include "channels_conf_line.h"
+#include "seek_index.h"
+#include "shared_ring.h"
+#include <arpa/inet.h>
 
 using namespace xmlpp;
 
@@ -44,6 +47,26 @@ String RequestHandler::get_attribute_value(const Node* node, const String& xpath
 	return dynamic_cast<Attribute*>(resultNode)->get_value();
 }
 
+String RequestHandler::get_attribute_value(const Node* node, const String& xpath, const String& default_value)
+{
+	Node* resultNode = get_attribute(node, xpath);
+	return resultNode == NULL ? default_value : dynamic_cast<Attribute*>(resultNode)->get_value();
+}
+
+// The address that a request came from, unicast streams are sent back to it
+String RequestHandler::get_peer_address(int sockfd)
+{
+	struct sockaddr_in address;
+	socklen_t length = sizeof(address);
+
+	if (getpeername(sockfd, (struct sockaddr*)&address, &length) == -1 || address.sin_family != AF_INET)
+	{
+		throw SystemException("Failed to get client address");
+	}
+
+	return inet_ntoa(address.sin_addr);
+}
+
 int RequestHandler::get_int_attribute_value(const Node* node, const String& xpath)
 {
 	return ::atoi(get_attribute_value(node, xpath).c_str());
@@ -213,22 +236,12 @@ gboolean RequestHandler::handle_connection(int sockfd)
 				for (ChannelStreamList::iterator j = streams.begin(); j != streams.end(); j++)
 				{
 					ChannelStream* stream = *j;
-					body += String::compose("<stream channel_id=\"%1\" type=\"%2\" description=\"%3\">",
-						stream->channel.id, stream->type, stream->get_description());
-					Dvb::DemuxerList& demuxers = stream->demuxers;
-					for (Dvb::DemuxerList::iterator k = demuxers.begin(); k != demuxers.end(); k++)
+					body += String::compose("<stream channel_id=\"%1\" type=\"%2\" description=\"%3\" overflow_count=\"%4\" %5>",
+						stream->channel.id, stream->type, stream->get_description(), stream->get_overflow_count(), stream->get_statistics());
+					std::vector<guint> pids = stream->stream.get_pids();
+					for (std::vector<guint>::iterator k = pids.begin(); k != pids.end(); k++)
 					{
-						Dvb::Demuxer* demuxer = *k;
-						String type = "None";
-						if (demuxer->filter_type == Dvb::Demuxer::FILTER_TYPE_PES)
-						{
-							type = "PES";
-						}
-						else if (demuxer->filter_type == Dvb::Demuxer::FILTER_TYPE_SECTION)
-						{
-							type = "SECTION";
-						}
-						body += String::compose("<demuxer pid=\"%1\" filter_type=\"%2\" />", demuxer->pid, type);
+						body += String::compose("<demuxer pid=\"%1\" filter_type=\"PES\" />", *k);
 					}
 					body += "</stream>";
 				}
@@ -315,17 +328,134 @@ gboolean RequestHandler::handle_connection(int sockfd)
 		{
 			int channel_id = ::atoi(get_attribute_value(root_node, "parameter[@name=\"channel\"]/@value").c_str());
 			Channel channel = ChannelManager::get(channel_id);
-			String protocol = "udp";
+			String protocol = get_attribute_value(root_node, "parameter[@name=\"protocol\"]/@value", "udp");
+			String mode = get_attribute_value(root_node, "parameter[@name=\"mode\"]/@value", "broadcast");
+			String address = broadcast_address;
+
+			if (protocol != "udp" && protocol != "rtp")
+			{
+				throw Exception(_("Unknown stream protocol"));
+			}
+
+			// Older clients only say whether they want multicast
+			if (mode == "broadcast" &&
+				get_attribute_value(root_node, "parameter[@name=\"multicast\"]/@value", "false") == "true")
+			{
+				mode = "multicast";
+			}
 
-			RequestHandler::Client& client = clients.get(client_id);
-			stream_manager.start_broadcasting(channel, client_id, "", broadcast_address, client.broadcast_port);
-			body += String::compose("<stream protocol=\"%1\" address=\"%2\" port=\"%3\" />",
-				protocol, broadcast_address, client.broadcast_port);
+			// Clients on the same host can read the stream from shared memory
+			if (mode == "local")
+			{
+				SharedRing* ring = new SharedRing(SHARED_RING_SIZE);
+				String stream = String::compose("<stream protocol=\"shm\" path=\"%1\" size=\"%2\" />",
+					encode_xml(ring->get_path()), ring->get_size());
+				try
+				{
+					stream_manager.start_broadcasting(channel, client_id, ring, true);
+				}
+				catch(...)
+				{
+					delete ring;
+					throw;
+				}
+				body += stream;
+			}
+			else
+			{
+				// Clients that opt in share one multicast send per channel
+				gboolean multicast = mode == "multicast" && !multicast_address.empty();
+				if (multicast)
+				{
+					address = multicast_address;
+				}
+				else if (mode == "unicast")
+				{
+					address = get_peer_address(sockfd);
+				}
+
+				RequestHandler::Client& client = clients.get(client_id);
+				int port = stream_manager.start_broadcasting(channel, client_id, multicast_interface,
+					address, client.broadcast_port, multicast, protocol == "rtp");
+				body += String::compose("<stream protocol=\"%1\" address=\"%2\" port=\"%3\" />",
+					protocol, address, port);
+			}
 		}
 		else if (command == "stop_broadcasting")
 		{
 			stream_manager.stop_broadcasting(client_id);
 		}
+		else if (command == "timeshift")
+		{
+			String action = get_attribute_value(root_node, "parameter[@name=\"action\"]/@value");
+			TimeshiftAction timeshift_action;
+
+			if (action == "pause")
+			{
+				timeshift_action = TIMESHIFT_ACTION_PAUSE;
+			}
+			else if (action == "play")
+			{
+				timeshift_action = TIMESHIFT_ACTION_PLAY;
+			}
+			else if (action == "seek")
+			{
+				timeshift_action = TIMESHIFT_ACTION_SEEK;
+			}
+			else if (action == "live")
+			{
+				timeshift_action = TIMESHIFT_ACTION_LIVE;
+			}
+			else
+			{
+				throw Exception(_("Unknown time-shift action"));
+			}
+
+			guint seconds = 0;
+			if (timeshift_action == TIMESHIFT_ACTION_SEEK)
+			{
+				seconds = get_int_attribute_value(root_node, "parameter[@name=\"seconds\"]/@value");
+			}
+			stream_manager.timeshift(client_id, timeshift_action, seconds);
+		}
+		else if (command == "start_multiplex_recording")
+		{
+			int channel_id = ::atoi(get_attribute_value(root_node, "parameter[@name=\"channel\"]/@value").c_str());
+			Channel channel = ChannelManager::get(channel_id);
+			String filename = stream_manager.start_multiplex_recording(channel);
+			body += String::compose("<recording filename=\"%1\" />", encode_xml(filename));
+		}
+		else if (command == "stop_multiplex_recording")
+		{
+			int channel_id = ::atoi(get_attribute_value(root_node, "parameter[@name=\"channel\"]/@value").c_str());
+			Channel channel = ChannelManager::get(channel_id);
+			stream_manager.stop_multiplex_recording(channel);
+		}
+		else if (command == "extract_service")
+		{
+			String filename = get_attribute_value(root_node, "parameter[@name=\"filename\"]/@value");
+			int channel_id = ::atoi(get_attribute_value(root_node, "parameter[@name=\"channel\"]/@value").c_str());
+			Channel channel = ChannelManager::get(channel_id);
+			String output_path = stream_manager.extract_service(filename, channel);
+			body += String::compose("<recording filename=\"%1\" />", encode_xml(output_path));
+		}
+		else if (command == "get_recording_offset")
+		{
+			String filename = get_attribute_value(root_node, "parameter[@name=\"filename\"]/@value");
+			guint64 seconds = ::atoll(get_attribute_value(root_node, "parameter[@name=\"seconds\"]/@value").c_str());
+
+			if (Glib::path_get_dirname(filename) != recording_directory)
+			{
+				throw Exception(_("Recording is not in the recording directory"));
+			}
+
+			guint64 offset = 0;
+			if (!SeekIndex::find(SeekIndex::get_path(filename), seconds, offset))
+			{
+				throw Exception(_("No seek index for recording"));
+			}
+			body += String::compose("<offset value=\"%1\" />", offset);
+		}
 		else if (command == "add_scheduled_recording")
 		{
 			int epg_event_id = ::atoi(get_attribute_value(root_node, "parameter[@name=\"epg_event_id\"]/@value").c_str());
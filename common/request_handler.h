@@ -58,6 +58,8 @@ private:
 
 	xmlpp::Node* get_attribute(const xmlpp::Node* node, const String& xpath);
 	String get_attribute_value(const xmlpp::Node* node, const String& xpath);
+	String get_attribute_value(const xmlpp::Node* node, const String& xpath, const String& default_value);
+	String get_peer_address(int sockfd);
 	int get_int_attribute_value(const xmlpp::Node* node, const String& xpath);
 	gboolean get_bool_attribute_value(const xmlpp::Node* node, const String& xpath);
 	void send_response(int sockfd,
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __RING_BUFFER_H__
+#define __RING_BUFFER_H__
+
+#include <glib.h>
+
+// Bounded single producer/single consumer queue.  One thread may call push(),
+// one other thread may call front() and pop(), neither ever blocks.  SIZE must
+// be a power of two, one slot is always kept free.
+template<typename T, guint SIZE>
+class RingBuffer
+{
+private:
+	T				items[SIZE];
+	volatile gint	head;
+	volatile gint	tail;
+
+public:
+	RingBuffer() : head(0), tail(0) {}
+
+	gboolean push(const T& item)
+	{
+		gint next = (head + 1) & (SIZE - 1);
+		if (next == g_atomic_int_get(&tail))
+		{
+			return false;
+		}
+
+		items[head] = item;
+		g_atomic_int_set(&head, next);
+		return true;
+	}
+
+	T* front()
+	{
+		if (tail == g_atomic_int_get(&head))
+		{
+			return NULL;
+		}
+		return &items[tail];
+	}
+
+	void pop()
+	{
+		g_atomic_int_set(&tail, (tail + 1) & (SIZE - 1));
+	}
+
+	gboolean is_empty()
+	{
+		return g_atomic_int_get(&tail) == g_atomic_int_get(&head);
+	}
+};
+
+#endif
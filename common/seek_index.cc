@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "seek_index.h"
+#include "mpeg_stream.h"
+#include "exception.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+SeekIndex::SeekIndex(const String& p) : path(p)
+{
+	last_pts = 0;
+	last_pts_valid = false;
+	buffer.reserve(SEEK_INDEX_BUFFER_SIZE);
+
+	if ((fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		throw SystemException(_("Failed to open seek index"));
+	}
+
+	buffer.insert(buffer.end(), SEEK_INDEX_MAGIC, SEEK_INDEX_MAGIC + 8);
+}
+
+SeekIndex::~SeekIndex()
+{
+	try
+	{
+		flush();
+	}
+	catch(const Glib::Exception& ex)
+	{
+		g_message("Failed to write seek index '%s': %s", path.c_str(), ex.what().c_str());
+	}
+
+	::close(fd);
+}
+
+static void append_le(std::vector<guchar>& buffer, guint64 value, guint size)
+{
+	for (guint i = 0; i < size; i++)
+	{
+		buffer.push_back((value >> (i * 8)) & 0xff);
+	}
+}
+
+// Called for each video packet that starts a PES.  Random access points are always
+// indexed, other PES starts only every SEEK_INDEX_INTERVAL.
+void SeekIndex::add(guint64 offset, const guchar* packet, guint stream_type)
+{
+	guint64 pts = 0;
+	gboolean has_pts = Mpeg::get_pts(packet, pts);
+	gboolean random_access = Mpeg::is_random_access(packet, stream_type);
+
+	if (!random_access)
+	{
+		if (!has_pts)
+		{
+			return;
+		}
+
+		if (last_pts_valid && ((pts - last_pts) & G_GUINT64_CONSTANT(0x1FFFFFFFF)) < SEEK_INDEX_INTERVAL)
+		{
+			return;
+		}
+	}
+
+	if (has_pts)
+	{
+		last_pts = pts;
+		last_pts_valid = true;
+	}
+
+	append_le(buffer, offset, 8);
+	append_le(buffer, has_pts ? pts : last_pts, 8);
+	append_le(buffer, random_access ? SEEK_INDEX_FLAG_RANDOM_ACCESS : 0, 4);
+	append_le(buffer, 0, 4);
+
+	if (buffer.size() >= SEEK_INDEX_BUFFER_SIZE)
+	{
+		write_buffer();
+	}
+}
+
+void SeekIndex::flush()
+{
+	if (!buffer.empty())
+	{
+		write_buffer();
+	}
+}
+
+void SeekIndex::write_buffer()
+{
+	gsize written = 0;
+	while (written < buffer.size())
+	{
+		gssize result = ::write(fd, &buffer[written], buffer.size() - written);
+		if (result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			buffer.clear();
+			throw SystemException(_("Failed to write seek index"));
+		}
+		written += result;
+	}
+
+	buffer.clear();
+}
+
+static guint64 read_le(const guchar* data, guint size)
+{
+	guint64 value = 0;
+	for (guint i = size; i > 0; i--)
+	{
+		value = (value << 8) | data[i - 1];
+	}
+	return value;
+}
+
+// Finds the offset of the last random access point at or before the given number
+// of seconds into the recording with a binary search of the index
+gboolean SeekIndex::find(const String& path, guint64 seconds, guint64& offset)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	guchar record[SEEK_INDEX_RECORD_SIZE];
+	gboolean found = false;
+	off_t size = lseek(fd, 0, SEEK_END);
+	gint64 count = size > 8 ? (size - 8) / SEEK_INDEX_RECORD_SIZE : 0;
+
+	if (count > 0 && pread(fd, record, SEEK_INDEX_RECORD_SIZE, 8) == SEEK_INDEX_RECORD_SIZE)
+	{
+		guint64 first_pts = read_le(record + 8, 8);
+		guint64 target = seconds * 90000;
+
+		gint64 low = 0;
+		gint64 high = count - 1;
+		gint64 best = 0;
+
+		while (low <= high)
+		{
+			gint64 middle = (low + high) / 2;
+			if (pread(fd, record, SEEK_INDEX_RECORD_SIZE, 8 + middle * SEEK_INDEX_RECORD_SIZE) != SEEK_INDEX_RECORD_SIZE)
+			{
+				break;
+			}
+
+			guint64 elapsed = (read_le(record + 8, 8) - first_pts) & G_GUINT64_CONSTANT(0x1FFFFFFFF);
+			if (elapsed <= target)
+			{
+				best = middle;
+				low = middle + 1;
+			}
+			else
+			{
+				high = middle - 1;
+			}
+		}
+
+		for (gint64 i = best; i >= 0 && !found; i--)
+		{
+			if (pread(fd, record, SEEK_INDEX_RECORD_SIZE, 8 + i * SEEK_INDEX_RECORD_SIZE) != SEEK_INDEX_RECORD_SIZE)
+			{
+				break;
+			}
+
+			if (read_le(record + 16, 4) & SEEK_INDEX_FLAG_RANDOM_ACCESS)
+			{
+				offset = read_le(record, 8);
+				found = true;
+			}
+		}
+	}
+
+	::close(fd);
+
+	return found;
+}
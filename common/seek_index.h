@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __SEEK_INDEX_H__
+#define __SEEK_INDEX_H__
+
+#include "me-tv-types.h"
+
+#define SEEK_INDEX_MAGIC			"METVIDX1"
+#define SEEK_INDEX_RECORD_SIZE		24
+#define SEEK_INDEX_INTERVAL			90000 // 90kHz ticks between entries that are not random access points
+#define SEEK_INDEX_BUFFER_SIZE		(SEEK_INDEX_RECORD_SIZE * 256)
+
+#define SEEK_INDEX_FLAG_RANDOM_ACCESS	0x01
+
+// Sidecar index written next to a recording.  After the 8 byte magic it holds fixed
+// size little endian records of { guint64 offset, guint64 pts, guint32 flags,
+// guint32 reserved } in file order, so a reader can binary search it by time.
+class SeekIndex
+{
+private:
+	int					fd;
+	String				path;
+	std::vector<guchar>	buffer;
+	guint64				last_pts;
+	gboolean			last_pts_valid;
+
+	void write_buffer();
+
+public:
+	SeekIndex(const String& path);
+	~SeekIndex();
+
+	void add(guint64 offset, const guchar* packet, guint stream_type);
+	void flush();
+
+	static String get_path(const String& recording_path) { return recording_path + ".idx"; }
+	static gboolean find(const String& path, guint64 seconds, guint64& offset);
+};
+
+#endif
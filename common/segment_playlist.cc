@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "segment_playlist.h"
+#include "exception.h"
+#include <math.h>
+
+SegmentPlaylist::SegmentPlaylist(const String& p) : path(p)
+{
+	target_duration = 1;
+	write(false);
+}
+
+SegmentPlaylist::~SegmentPlaylist()
+{
+	try
+	{
+		write(true);
+	}
+	catch(const Glib::Exception& ex)
+	{
+		g_message("Failed to write segment playlist '%s': %s", path.c_str(), ex.what().c_str());
+	}
+}
+
+static String strip_extension(const String& recording_path)
+{
+	String::size_type dot = recording_path.rfind('.');
+	String::size_type slash = recording_path.rfind('/');
+	if (dot == String::npos || (slash != String::npos && dot < slash))
+	{
+		return recording_path;
+	}
+	return recording_path.substr(0, dot);
+}
+
+String SegmentPlaylist::get_path(const String& recording_path)
+{
+	return strip_extension(recording_path) + ".m3u8";
+}
+
+String SegmentPlaylist::get_segment_path(const String& recording_path, guint index)
+{
+	gchar number[16];
+	g_snprintf(number, sizeof(number), "%05u", index);
+	return String::compose("%1.%2.mpeg", strip_extension(recording_path), number);
+}
+
+void SegmentPlaylist::add(const String& segment_path, gdouble duration)
+{
+	Segment segment;
+	segment.filename = Glib::path_get_basename(segment_path);
+	segment.duration = duration;
+	segments.push_back(segment);
+
+	target_duration = MAX(target_duration, (guint)ceil(duration));
+	write(false);
+}
+
+// Replaces the playlist in one step so that readers never see a partial file
+void SegmentPlaylist::write(gboolean complete)
+{
+	String text = String::compose("#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-PLAYLIST-TYPE:EVENT\n#EXT-X-TARGETDURATION:%1\n#EXT-X-MEDIA-SEQUENCE:0\n", target_duration);
+
+	for (SegmentList::iterator i = segments.begin(); i != segments.end(); i++)
+	{
+		gchar duration[G_ASCII_DTOSTR_BUF_SIZE];
+		g_ascii_formatd(duration, sizeof(duration), "%.3f", i->duration);
+		text += String::compose("#EXTINF:%1,\n%2\n", duration, i->filename);
+	}
+
+	if (complete)
+	{
+		text += "#EXT-X-ENDLIST\n";
+	}
+
+	Glib::file_set_contents(path, text);
+}
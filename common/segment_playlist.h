@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __SEGMENT_PLAYLIST_H__
+#define __SEGMENT_PLAYLIST_H__
+
+#include "me-tv-types.h"
+#include <list>
+
+// An HLS style playlist of the segments of a recording.  It is rewritten as each
+// segment is completed, so that the finished part of a recording can be played or
+// processed while the rest is still being recorded.
+class SegmentPlaylist
+{
+private:
+	class Segment
+	{
+	public:
+		String	filename;
+		gdouble	duration;
+	};
+	typedef std::list<Segment> SegmentList;
+
+	String		path;
+	SegmentList	segments;
+	guint		target_duration;
+
+	void write(gboolean complete);
+
+public:
+	SegmentPlaylist(const String& path);
+	~SegmentPlaylist();
+
+	void add(const String& segment_path, gdouble duration);
+
+	static String get_path(const String& recording_path);
+	static String get_segment_path(const String& recording_path, guint index);
+};
+
+#endif
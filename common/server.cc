@@ -24,10 +24,21 @@
 #include "data.h"
 #include "crc32.h"
 
-Server::Server(int port) : server_thread(port)
+Server::Server(int port, int http_port) : server_thread(port)
 {
 	Gnome::Gda::init();
 	Crc32::init();
+
+	http_server_thread = NULL;
+	if (http_port > 0)
+	{
+		http_server_thread = new HttpServerThread(http_port);
+	}
+}
+
+Server::~Server()
+{
+	delete http_server_thread;
 }
 
 void Server::start()
@@ -41,10 +52,25 @@ void Server::start()
 	stream_manager.initialise(text_encoding, read_timeout, ignore_teletext);
 	stream_manager.start();
 
+	if (pace_output)
+	{
+		datagram_pacer.start();
+	}
+
 	server_thread.start();
+
+	if (http_server_thread != NULL)
+	{
+		http_server_thread->start();
+	}
 }
 
 void Server::stop()
 {
 	server_thread.terminate();
+
+	if (http_server_thread != NULL)
+	{
+		http_server_thread->join(true);
+	}
 }
@@ -22,14 +22,17 @@
 #define __SERVER_H__
 
 #include "network_server_thread.h"
+#include "http_server_thread.h"
 
 class Server
 {
 private:
 	NetworkServerThread server_thread;
+	HttpServerThread* http_server_thread;
 	
 public:
-	Server(int port);
+	Server(int port, int http_port);
+	~Server();
 	
 	void start();
 	void stop();
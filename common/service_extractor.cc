@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "service_extractor.h"
+#include "psi_tracker.h"
+#include "dvb_si.h"
+#include "exception.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+ServiceExtractor::ServiceExtractor(const String& input, const String& output, guint id)
+	: Thread("Service Extractor"), input_path(input), output_path(output), service_id(id)
+{
+	finished = false;
+}
+
+ServiceExtractor::~ServiceExtractor()
+{
+	join(true);
+}
+
+void ServiceExtractor::run()
+{
+	g_debug("Extracting service %d from '%s' to '%s'", service_id, input_path.c_str(), output_path.c_str());
+
+	int fd = -1;
+
+	try
+	{
+		if ((fd = ::open(input_path.c_str(), O_RDONLY)) < 0)
+		{
+			throw SystemException(_("Failed to open multiplex recording"));
+		}
+
+		Glib::RefPtr<Glib::IOChannel> output_channel = Glib::IOChannel::create_from_file(output_path, "w");
+		output_channel->set_encoding("");
+		output_channel->set_buffer_size(TS_PACKET_SIZE * PACKET_BUFFER_SIZE);
+
+		// A recording has no tuning of its own, the transponder is only used to
+		// match updates to live streams
+		Dvb::Transponder transponder;
+		PsiTracker psi_tracker;
+		PsiTracker::ServiceMap services;
+		PsiUpdateList updates;
+		services[service_id] = NULL_PID;
+
+		Mpeg::Stream stream;
+		std::vector<gboolean> wanted(PID_COUNT, false);
+		gboolean have_layout = false;
+
+		guchar pat[TS_PACKET_SIZE];
+		guchar pmt[TS_PACKET_SIZE];
+		guint pat_counter = 0;
+		guint pmt_counter = 0;
+
+		guchar buffer[TS_PACKET_SIZE * PACKET_BUFFER_SIZE];
+		gsize length = 0;
+		gsize bytes_written = 0;
+
+		while (!is_terminated())
+		{
+			gssize bytes_read = ::read(fd, buffer + length, sizeof(buffer) - length);
+			if (bytes_read < 0)
+			{
+				throw SystemException(_("Failed to read multiplex recording"));
+			}
+
+			if (bytes_read == 0)
+			{
+				break;
+			}
+
+			length += bytes_read;
+			gsize end = length - (length % TS_PACKET_SIZE);
+
+			for (gsize offset = 0; offset < end; offset += TS_PACKET_SIZE)
+			{
+				const guchar* packet = buffer + offset;
+				guint pid = ((packet[1] & 0x1f) << 8) + packet[2];
+
+				if (pid == PAT_PID || pid == services[service_id])
+				{
+					psi_tracker.push(packet, transponder, services, updates);
+
+					for (PsiUpdateList::iterator i = updates.begin(); i != updates.end(); i++)
+					{
+						services[service_id] = i->pmt_pid;
+						if (!i->section.empty())
+						{
+							Buffer section;
+							section.set_length(i->section.size());
+							memcpy(section.get_buffer(), &i->section[0], i->section.size());
+
+							stream.clear();
+							stream.set_pmt_pid(i->pmt_pid);
+							stream.parse_pms(section, false);
+
+							std::vector<guint> pids = stream.get_pids();
+							wanted.assign(PID_COUNT, false);
+							for (std::vector<guint>::iterator j = pids.begin(); j != pids.end(); j++)
+							{
+								wanted[*j & (PID_COUNT - 1)] = true;
+							}
+
+							stream.build_pat(pat);
+							stream.build_pmt(pmt);
+							have_layout = true;
+						}
+					}
+					updates.clear();
+
+					// Our PAT and PMT go out as often as the multiplex has its PAT
+					if (have_layout && pid == PAT_PID && (packet[1] & 0x40))
+					{
+						pat[3] = 0x10 | (pat_counter++ & 0x0f);
+						pmt[3] = 0x10 | (pmt_counter++ & 0x0f);
+						output_channel->write((const gchar*)pat, TS_PACKET_SIZE, bytes_written);
+						output_channel->write((const gchar*)pmt, TS_PACKET_SIZE, bytes_written);
+					}
+				}
+
+				if (have_layout && wanted[pid])
+				{
+					output_channel->write((const gchar*)packet, TS_PACKET_SIZE, bytes_written);
+				}
+			}
+
+			length -= end;
+			memmove(buffer, buffer + end, length);
+		}
+
+		output_channel->flush();
+		g_debug("Finished extracting service %d to '%s'", service_id, output_path.c_str());
+	}
+	catch(const Glib::Exception& ex)
+	{
+		g_message("Failed to extract service %d: %s", service_id, ex.what().c_str());
+	}
+	catch(...)
+	{
+		g_message("Failed to extract service %d", service_id);
+	}
+
+	if (fd != -1)
+	{
+		::close(fd);
+	}
+
+	g_atomic_int_set(&finished, true);
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __SERVICE_EXTRACTOR_H__
+#define __SERVICE_EXTRACTOR_H__
+
+#include "thread.h"
+#include "mpeg_stream.h"
+
+// Copies one service out of a multiplex recording into its own file, with a PAT
+// and PMT for just that service.  Follows PMT changes in the recording.
+class ServiceExtractor : public Thread
+{
+private:
+	String	input_path;
+	String	output_path;
+	guint	service_id;
+	volatile gint	finished;
+
+	void run();
+
+public:
+	ServiceExtractor(const String& input_path, const String& output_path, guint service_id);
+	~ServiceExtractor();
+
+	const String& get_output_path() const { return output_path; }
+	gboolean is_finished() { return g_atomic_int_get(&finished); }
+};
+
+typedef std::list<ServiceExtractor*> ServiceExtractorList;
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "shared_ring.h"
+#include "exception.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+// Creates the ring, for the server
+SharedRing::SharedRing(guint64 s)
+{
+	size = s - (s % TS_PACKET_SIZE);
+	map_size = SHARED_RING_DATA_OFFSET + size;
+	read_position = 0;
+
+	fd = memfd_create("me-tv-stream", 0);
+	if (fd < 0)
+	{
+		throw SystemException(_("Failed to create shared stream buffer"));
+	}
+
+	if (ftruncate(fd, map_size) < 0)
+	{
+		::close(fd);
+		throw SystemException(_("Failed to size shared stream buffer"));
+	}
+
+	map = (guchar*)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		::close(fd);
+		throw SystemException(_("Failed to map shared stream buffer"));
+	}
+
+	header = (SharedRingHeader*)map;
+	data = map + SHARED_RING_DATA_OFFSET;
+	header->size = size;
+	header->write_position = 0;
+	header->write_end = 0;
+	header->magic = SHARED_RING_MAGIC;
+}
+
+// Opens a ring created by the server, for the client
+SharedRing::SharedRing(const String& path)
+{
+	read_position = 0;
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw SystemException(_("Failed to open shared stream buffer"));
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) < 0 || (gsize)status.st_size <= SHARED_RING_DATA_OFFSET)
+	{
+		::close(fd);
+		throw Exception(_("Invalid shared stream buffer"));
+	}
+
+	map_size = status.st_size;
+	map = (guchar*)mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		::close(fd);
+		throw SystemException(_("Failed to map shared stream buffer"));
+	}
+
+	header = (SharedRingHeader*)map;
+	data = map + SHARED_RING_DATA_OFFSET;
+	size = header->size;
+
+	if (header->magic != SHARED_RING_MAGIC || size + SHARED_RING_DATA_OFFSET > map_size)
+	{
+		munmap(map, map_size);
+		::close(fd);
+		throw Exception(_("Invalid shared stream buffer"));
+	}
+
+	// Start at the live position
+	read_position = __atomic_load_n(&header->write_position, __ATOMIC_ACQUIRE);
+}
+
+SharedRing::~SharedRing()
+{
+	munmap(map, map_size);
+	::close(fd);
+}
+
+String SharedRing::get_path() const
+{
+	return String::compose("/proc/%1/fd/%2", getpid(), fd);
+}
+
+// Moves a reader that has been lapped back to half a ring behind the writer
+void SharedRing::skip(guint64 write_position)
+{
+	guint64 position = write_position - size / 2;
+	position -= position % TS_PACKET_SIZE;
+
+	g_debug("Shared stream buffer overrun, skipping %" G_GUINT64_FORMAT " bytes", position - read_position);
+	read_position = position;
+}
+
+void SharedRing::write(const guchar* buffer, gsize length)
+{
+	guint64 position = header->write_position;
+
+	__atomic_store_n(&header->write_end, position + length, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	while (length > 0)
+	{
+		guint64 offset = position % size;
+		gsize count = MIN(length, size - offset);
+
+		memcpy(data + offset, buffer, count);
+		position += count;
+		buffer += count;
+		length -= count;
+	}
+
+	__atomic_store_n(&header->write_position, position, __ATOMIC_RELEASE);
+}
+
+// Copies out whatever has been written since the last read, waiting up to timeout
+// milliseconds for something to be written.  Data that the writer may have
+// overwritten while it was being copied is thrown away.
+gsize SharedRing::read(guchar* buffer, gsize length, guint timeout)
+{
+	guint64 write_position = __atomic_load_n(&header->write_position, __ATOMIC_ACQUIRE);
+
+	for (guint waited = 0; write_position == read_position && waited < timeout; waited += SHARED_RING_POLL_INTERVAL)
+	{
+		usleep(SHARED_RING_POLL_INTERVAL * 1000);
+		write_position = __atomic_load_n(&header->write_position, __ATOMIC_ACQUIRE);
+	}
+
+	if (write_position - read_position > size)
+	{
+		skip(write_position);
+	}
+
+	length = MIN((guint64)length, write_position - read_position);
+
+	gsize total = 0;
+	while (total < length)
+	{
+		guint64 offset = (read_position + total) % size;
+		gsize count = MIN((guint64)(length - total), size - offset);
+
+		memcpy(buffer + total, data + offset, count);
+		total += count;
+	}
+
+	// Any write that started before the copy finished may have reached the data
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	guint64 write_end = __atomic_load_n(&header->write_end, __ATOMIC_RELAXED);
+	if (write_end - read_position > size)
+	{
+		skip(write_end);
+		return 0;
+	}
+
+	read_position += total;
+	return total;
+}
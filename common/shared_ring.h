@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __SHARED_RING_H__
+#define __SHARED_RING_H__
+
+#include "stream_sink.h"
+#include "mpeg_stream.h"
+
+#define SHARED_RING_MAGIC		0x5256544d // "MTVR"
+#define SHARED_RING_DATA_OFFSET	4096
+#define SHARED_RING_SIZE		(TS_PACKET_SIZE * 65536) // about 12MB
+#define SHARED_RING_READ_SIZE	(TS_PACKET_SIZE * 1024)
+#define SHARED_RING_POLL_INTERVAL	10 // milliseconds
+
+// The first page of the shared memory, the data follows at SHARED_RING_DATA_OFFSET
+typedef struct
+{
+	guint32	magic;
+	guint32	reserved;
+	guint64	size;
+	guint64	write_position;
+	guint64	write_end;
+} SharedRingHeader;
+
+// A circular buffer in a memfd that the server writes a stream into and a client
+// on the same host maps and reads from.  Positions are byte counts since the ring
+// was created, a reader that gets lapped skips forward instead of blocking the
+// writer.  The writer announces the end of a write in write_end before copying and
+// publishes write_position after, so a reader can tell if its copy was overwritten.
+// The client opens the ring through the server's /proc/<pid>/fd entry.
+class SharedRing : public StreamSink
+{
+private:
+	int					fd;
+	guchar*				map;
+	gsize				map_size;
+	SharedRingHeader*	header;
+	guchar*				data;
+	guint64				size;
+	guint64				read_position;
+
+	void skip(guint64 write_position);
+
+public:
+	SharedRing(guint64 size);
+	SharedRing(const String& path);
+	~SharedRing();
+
+	String get_path() const;
+	guint64 get_size() const { return size; }
+
+	void write(const guchar* buffer, gsize length);
+	gsize read(guchar* buffer, gsize length, guint timeout = 0);
+};
+
+#endif
@@ -26,6 +26,11 @@
 #include "dvb_si.h"
 #include "exception.h"
 
+StreamManager::StreamManager()
+{
+	g_static_rec_mutex_init(service_extractors_mutex.gobj());
+}
+
 void StreamManager::initialise(const String& text_encoding, guint timeout, gboolean ignore_teletext)
 {
 	g_debug("Creating stream manager");
@@ -43,6 +48,12 @@ StreamManager::~StreamManager()
 	g_debug("Destroying StreamManager");
 	stop();
 
+	while (!service_extractors.empty())
+	{
+		delete service_extractors.front();
+		service_extractors.pop_front();
+	}
+
 	FrontendThreadList::iterator i = frontend_threads.begin(); 
 	while (i != frontend_threads.end())
 	{
@@ -96,6 +107,83 @@ void StreamManager::stop_recording(const Channel& channel)
 	}
 }
 
+String StreamManager::start_multiplex_recording(Channel& channel)
+{
+	for (FrontendThreadList::iterator i = frontend_threads.begin(); i != frontend_threads.end(); i++)
+	{
+		FrontendThread& frontend_thread = **i;
+		if (frontend_thread.frontend.get_frontend_type() == channel.transponder.frontend_type &&
+			frontend_thread.is_available(channel) && !frontend_thread.is_recording_multiplex())
+		{
+			g_debug("Selected frontend '%s' (%s) for multiplex recording",
+				frontend_thread.frontend.get_name().c_str(),
+				frontend_thread.frontend.get_path().c_str());
+			return frontend_thread.start_multiplex_recording(channel);
+		}
+	}
+
+	throw Exception(_("Failed to get available frontend"));
+}
+
+void StreamManager::stop_multiplex_recording(const Channel& channel)
+{
+	for (FrontendThreadList::iterator i = frontend_threads.begin(); i != frontend_threads.end(); i++)
+	{
+		FrontendThread& frontend_thread = **i;
+		if (channel.transponder == frontend_thread.frontend.get_frontend_parameters())
+		{
+			frontend_thread.stop_multiplex_recording();
+		}
+	}
+}
+
+// Starts extracting a channel from a multiplex recording in the background,
+// returns the name of the file being written
+String StreamManager::extract_service(const String& filename, const Channel& channel)
+{
+	if (Glib::path_get_dirname(filename) != recording_directory)
+	{
+		throw Exception(_("Multiplex recording is not in the recording directory"));
+	}
+
+	Glib::RecMutex::Lock lock(service_extractors_mutex);
+
+	ServiceExtractorList::iterator i = service_extractors.begin();
+	while (i != service_extractors.end())
+	{
+		if ((*i)->is_finished())
+		{
+			delete *i;
+			i = service_extractors.erase(i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	String basename = filename;
+	String::size_type position = basename.rfind('.');
+	if (position != String::npos)
+	{
+		basename = basename.substr(0, position);
+	}
+
+	String channel_name = channel.name;
+	while ((position = channel_name.find('/')) != String::npos)
+	{
+		channel_name.replace(position, 1, "_");
+	}
+
+	String output_path = String::compose("%1 - %2.mpeg", basename, channel_name);
+
+	ServiceExtractor* service_extractor = new ServiceExtractor(filename, output_path, channel.service_id);
+	service_extractors.push_back(service_extractor);
+	service_extractor->start();
+
+	return output_path;
+}
+
 void StreamManager::start()
 {
 	for (FrontendThreadList::iterator i = frontend_threads.begin(); i != frontend_threads.end(); i++)
@@ -116,11 +204,23 @@ void StreamManager::stop()
 	}
 }
 
-void StreamManager::start_broadcasting(Channel& channel, int client_id, const String& interface, const String& address, int port)
+// A frontend already broadcasting the channel is shared, otherwise the first
+// available frontend is used
+FrontendThread& StreamManager::get_broadcast_frontend(const Channel& channel)
 {
-	gboolean found = false;
+	for (FrontendThreadList::iterator i = frontend_threads.begin(); i != frontend_threads.end(); i++)
+	{
+		FrontendThread& frontend_thread = **i;
+		if (frontend_thread.is_broadcasting(channel))
+		{
+			g_debug("Sharing broadcast on frontend '%s' (%s)",
+				frontend_thread.frontend.get_name().c_str(),
+				frontend_thread.frontend.get_path().c_str());
+			return frontend_thread;
+		}
+	}
 
-	for (FrontendThreadList::iterator i = frontend_threads.begin(); i != frontend_threads.end() && !found; i++)
+	for (FrontendThreadList::iterator i = frontend_threads.begin(); i != frontend_threads.end(); i++)
 	{
 		FrontendThread& frontend_thread = **i;
 		if (frontend_thread.frontend.get_frontend_type() != channel.transponder.frontend_type)
@@ -134,16 +234,22 @@ void StreamManager::start_broadcasting(Channel& channel, int client_id, const St
 			g_debug("Selected frontend '%s' (%s) for broadcast",
 				frontend_thread.frontend.get_name().c_str(),
 				frontend_thread.frontend.get_path().c_str());
-			frontend_thread.start_broadcasting(channel, client_id, interface, address, port);
-			found = true;
-			break;
+			return frontend_thread;
 		}
 	}
 
-	if (!found)
-	{
-		throw Exception(_("Failed to get available frontend"));
-	}
+	throw Exception(_("Failed to get available frontend"));
+}
+
+// Returns the port that the client will be sent to
+int StreamManager::start_broadcasting(Channel& channel, int client_id, const String& interface, const String& address, int port, gboolean multicast, gboolean rtp)
+{
+	return get_broadcast_frontend(channel).start_broadcasting(channel, client_id, interface, address, port, multicast, rtp);
+}
+
+void StreamManager::start_broadcasting(Channel& channel, int client_id, StreamSink* sink, gboolean owns_sink)
+{
+	get_broadcast_frontend(channel).start_broadcasting(channel, client_id, sink, owns_sink);
 }
 
 void StreamManager::stop_broadcasting(int client_id)
@@ -154,6 +260,19 @@ void StreamManager::stop_broadcasting(int client_id)
 	}
 }
 
+void StreamManager::timeshift(int client_id, TimeshiftAction action, guint seconds)
+{
+	for (FrontendThreadList::iterator i = frontend_threads.begin(); i != frontend_threads.end(); i++)
+	{
+		if ((*i)->timeshift(client_id, action, seconds))
+		{
+			return;
+		}
+	}
+
+	throw Exception(_("Client is not broadcasting"));
+}
+
 gboolean StreamManager::is_broadcasting(const String& device)
 {
 	for (FrontendThreadList::iterator i = frontend_threads.begin(); i != frontend_threads.end(); i++)
@@ -24,24 +24,36 @@
 #include "frontend_thread.h"
 #include "scheduled_recording.h"
 #include "channel_stream.h"
+#include "service_extractor.h"
 
 class StreamManager
 {
 private:
 	FrontendThreadList frontend_threads;
+	ServiceExtractorList service_extractors;
+	Glib::StaticRecMutex service_extractors_mutex;
+
+	FrontendThread& get_broadcast_frontend(const Channel& channel);
 	
 public:
+	StreamManager();
 	void initialise(const String& text_encoding, guint timeout, gboolean ignore_teletext);
 	~StreamManager();
 			
 	FrontendThreadList& get_frontend_threads() { return frontend_threads; };
 
-	void start_broadcasting(Channel& channel, int client_id, const String& interface, const String& address, int port);
+	int start_broadcasting(Channel& channel, int client_id, const String& interface, const String& address, int port, gboolean multicast, gboolean rtp);
+	void start_broadcasting(Channel& channel, int client_id, StreamSink* sink, gboolean owns_sink = false);
 	void stop_broadcasting(int client_id);
+	void timeshift(int client_id, TimeshiftAction action, guint seconds);
 
 	void start_recording(const ScheduledRecording& scheduled_recording);
 	void stop_recording(const Channel& channel);
 
+	String start_multiplex_recording(Channel& channel);
+	void stop_multiplex_recording(const Channel& channel);
+	String extract_service(const String& filename, const Channel& channel);
+
 	gboolean is_broadcasting(const String& device);
 
 	void start();
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "stream_sink.h"
+
+BufferedStreamSink::BufferedStreamSink()
+{
+	g_static_mutex_init(mutex.gobj());
+	overflowed = false;
+}
+
+void BufferedStreamSink::write(const guchar* buffer, gsize length)
+{
+	Glib::Mutex::Lock lock(mutex);
+
+	if (overflowed || pending.size() + length > STREAM_SINK_MAX_SIZE)
+	{
+		overflowed = true;
+		return;
+	}
+
+	pending.insert(pending.end(), buffer, buffer + length);
+}
+
+// Swaps the pending data out, data is cleared first so its storage can be reused
+void BufferedStreamSink::read(std::vector<guchar>& data)
+{
+	data.clear();
+
+	Glib::Mutex::Lock lock(mutex);
+	pending.swap(data);
+}
+
+gboolean BufferedStreamSink::is_overflowed()
+{
+	Glib::Mutex::Lock lock(mutex);
+	return overflowed;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __STREAM_SINK_H__
+#define __STREAM_SINK_H__
+
+#include "me-tv-types.h"
+#include <vector>
+
+#define STREAM_SINK_MAX_SIZE	(4 * 1024 * 1024)
+
+// Receives a broadcast stream's data on its writer thread, write() must not block
+class StreamSink
+{
+public:
+	virtual ~StreamSink() {}
+	virtual void write(const guchar* buffer, gsize length) = 0;
+};
+
+// Hands stream data from a channel stream's writer thread to a connection thread.
+// A connection that falls more than STREAM_SINK_MAX_SIZE behind is marked as
+// overflowed and should be dropped.
+class BufferedStreamSink : public StreamSink
+{
+private:
+	Glib::StaticMutex		mutex;
+	std::vector<guchar>		pending;
+	gboolean				overflowed;
+
+public:
+	BufferedStreamSink();
+
+	void write(const guchar* buffer, gsize length);
+	void read(std::vector<guchar>& data);
+	gboolean is_overflowed();
+};
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "text_decoder.h"
+#include "exception.h"
+#include <string.h>
+#include <errno.h>
+
+TextDecoder::TextDecoder(const String& e) : encoding(e)
+{
+	input.reserve(256);
+	output.reserve(1024);
+}
+
+TextDecoder::~TextDecoder()
+{
+	for (std::map<const gchar*, GIConv>::iterator i = converters.begin(); i != converters.end(); i++)
+	{
+		g_iconv_close(i->second);
+	}
+}
+
+// Appends the text in a length prefixed DVB string to s and returns the number
+// of bytes used, including the length byte
+gsize TextDecoder::decode(String& s, const guchar* buffer)
+{
+	gsize length = buffer[0];
+	if (length == 0)
+	{
+		return 1;
+	}
+
+	const guchar* text = buffer + 1;
+	const guchar* end = text + length;
+	const gchar* codeset = TEXT_DECODER_DEFAULT_CODESET;
+
+	if (encoding.length() > 0 && encoding != "auto")
+	{
+		codeset = encoding.c_str();
+	}
+	else // Determine codeset from stream
+	{
+		codeset = get_codeset(text, end);
+	}
+
+	if (text < end)
+	{
+		const CodePage* code_page = get_code_page(codeset);
+		if (code_page == NULL || !decode_code_page(s, code_page, text, end))
+		{
+			decode_iconv(s, codeset, text, end);
+		}
+	}
+
+	return length + 1;
+}
+
+// Reads the character table selection at the start of a string, EN 300 468 annex A
+const gchar* TextDecoder::get_codeset(const guchar*& text, const guchar* end)
+{
+	const gchar* codeset = TEXT_DECODER_DEFAULT_CODESET;
+
+	if (text >= end || text[0] >= 0x20)
+	{
+		return codeset;
+	}
+
+	switch (text[0])
+	{
+	case 0x01: codeset = "ISO-8859-5"; break;
+	case 0x02: codeset = "ISO-8859-6"; break;
+	case 0x03: codeset = "ISO-8859-7"; break;
+	case 0x04: codeset = "ISO-8859-8"; break;
+	case 0x05: codeset = "ISO-8859-9"; break;
+	case 0x06: codeset = "ISO-8859-10"; break;
+	case 0x07: codeset = "ISO-8859-11"; break;
+	case 0x08: codeset = "ISO-8859-12"; break;
+	case 0x09: codeset = "ISO-8859-13"; break;
+	case 0x0A: codeset = "ISO-8859-14"; break;
+	case 0x0B: codeset = "ISO-8859-15"; break;
+	case 0x11: codeset = "UTF-16BE"; break;
+	case 0x14: codeset = "UTF-16BE"; break;
+
+	case 0x10:
+		if (text + 3 <= end)
+		{
+			if (text[1] != 0x00)
+			{
+				g_warning("Second byte of code table id was not 0");
+			}
+
+			switch(text[2])
+			{
+			case 0x01: codeset = "ISO-8859-1"; break;
+			case 0x02: codeset = "ISO-8859-2"; break;
+			case 0x03: codeset = "ISO-8859-3"; break;
+			case 0x04: codeset = "ISO-8859-4"; break;
+			case 0x05: codeset = "ISO-8859-5"; break;
+			case 0x06: codeset = "ISO-8859-6"; break;
+			case 0x07: codeset = "ISO-8859-7"; break;
+			case 0x08: codeset = "ISO-8859-8"; break;
+			case 0x09: codeset = "ISO-8859-9"; break;
+			case 0x0A: codeset = "ISO-8859-10"; break;
+			case 0x0B: codeset = "ISO-8859-11"; break;
+			case 0x0C: codeset = "ISO-8859-12"; break;
+			case 0x0D: codeset = "ISO-8859-13"; break;
+			case 0x0E: codeset = "ISO-8859-14"; break;
+			case 0x0F: codeset = "ISO-8859-15"; break;
+			default: break;
+			}
+			text += 2;
+		}
+		break;
+
+	default: break;
+	}
+
+	text++;
+	return codeset;
+}
+
+GIConv TextDecoder::get_converter(const gchar* codeset)
+{
+	std::map<const gchar*, GIConv>::iterator i = converters.find(codeset);
+	if (i != converters.end())
+	{
+		return i->second;
+	}
+
+	GIConv converter = g_iconv_open("UTF-8", codeset);
+	if (converter == (GIConv)-1)
+	{
+		throw Exception(String::compose(_("Failed to convert to UTF-8: %1"),
+			String::compose(_("Unsupported codeset '%1'"), codeset)));
+	}
+
+	converters[codeset] = converter;
+	return converter;
+}
+
+// The characters for bytes 0xA0 to 0xFF of an ISO-8859 code page, found by
+// converting each byte once.  Bytes that the code page leaves undefined are 0.
+const TextDecoder::CodePage* TextDecoder::get_code_page(const gchar* codeset)
+{
+	std::map<const gchar*, CodePage>::iterator i = code_pages.find(codeset);
+	if (i != code_pages.end())
+	{
+		return &i->second;
+	}
+
+	if (g_ascii_strncasecmp(codeset, "ISO-8859-", 9) != 0)
+	{
+		return NULL;
+	}
+
+	GIConv converter;
+	try
+	{
+		converter = get_converter(codeset);
+	}
+	catch(...)
+	{
+		return NULL;
+	}
+
+	CodePage& code_page = code_pages[codeset];
+	code_page.resize(0x60);
+	for (guint byte = 0xA0; byte <= 0xFF; byte++)
+	{
+		gchar in = byte;
+		gchar out[8];
+		gchar* in_position = &in;
+		gchar* out_position = out;
+		gsize in_left = 1;
+		gsize out_left = sizeof(out);
+
+		g_iconv(converter, NULL, NULL, NULL, NULL);
+		if (g_iconv(converter, &in_position, &in_left, &out_position, &out_left) != (gsize)-1 && in_left == 0)
+		{
+			*out_position = 0;
+			code_page[byte - 0xA0] = g_utf8_get_char(out);
+		}
+	}
+
+	return &code_page;
+}
+
+// Returns false, having appended nothing, if the text uses a byte that the
+// code page does not define so that iconv can report it
+gboolean TextDecoder::decode_code_page(String& s, const CodePage* code_page, const guchar* text, const guchar* end)
+{
+	output.clear();
+
+	for (const guchar* position = text; position < end; position++)
+	{
+		guchar ch = *position;
+
+		if (ch < 0x80)
+		{
+			output.push_back(ch);
+		}
+		else if (ch == 0x86 || ch == 0x87)
+		{
+			// Ignore formatting
+		}
+		else if (ch == 0x8A)
+		{
+			output.push_back('\n');
+		}
+		else if (ch < 0xA0)
+		{
+			output.push_back('.');
+		}
+		else
+		{
+			gunichar character = (*code_page)[ch - 0xA0];
+			if (character == 0)
+			{
+				return false;
+			}
+
+			gchar utf8[6];
+			gint count = g_unichar_to_utf8(character, utf8);
+			output.insert(output.end(), utf8, utf8 + count);
+		}
+	}
+
+	output.push_back(0);
+	s += &output[0];
+
+	return true;
+}
+
+void TextDecoder::decode_iconv(String& s, const gchar* codeset, const guchar* text, const guchar* end)
+{
+	gboolean is_utf16 = strcmp(codeset, "UTF-16BE") == 0;
+
+	input.clear();
+	for (const guchar* position = text; position < end; position++)
+	{
+		guchar ch = *position;
+
+		if (is_utf16)
+		{
+			input.push_back(ch);
+		}
+		else if (ch == 0x86 || ch == 0x87)
+		{
+			// Ignore formatting
+		}
+		else if (ch == 0x8A)
+		{
+			input.push_back('\n');
+		}
+		else if (ch >= 0x80 && ch < 0xA0)
+		{
+			input.push_back('.');
+		}
+		else
+		{
+			input.push_back(ch);
+		}
+	}
+
+	GIConv converter = get_converter(codeset);
+	g_iconv(converter, NULL, NULL, NULL, NULL);
+
+	output.resize(MAX(output.capacity(), input.size() * 3 + 16));
+
+	gchar* in_position = input.empty() ? NULL : &input[0];
+	gsize in_left = input.size();
+	gsize written = 0;
+
+	while (in_left > 0)
+	{
+		gchar* out_position = &output[written];
+		gsize out_left = output.size() - written - 1;
+
+		gsize result = g_iconv(converter, &in_position, &in_left, &out_position, &out_left);
+		written = out_position - &output[0];
+
+		if (result == (gsize)-1)
+		{
+			if (errno == E2BIG)
+			{
+				output.resize(output.size() * 2);
+				continue;
+			}
+
+			g_debug("Codeset: %s", codeset);
+			g_debug("Length: %zu", (gsize)(end - text));
+			throw Exception(String::compose(_("Failed to convert to UTF-8: %1"), String(g_strerror(errno))));
+		}
+	}
+
+	output[written] = 0;
+	s += &output[0];
+}
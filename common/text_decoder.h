@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __TEXT_DECODER_H__
+#define __TEXT_DECODER_H__
+
+#include "me-tv-types.h"
+#include <map>
+#include <vector>
+
+#define TEXT_DECODER_DEFAULT_CODESET	"ISO-8859-15"
+
+// Converts DVB SI strings to UTF-8.  ISO-8859 text, by far the most common, is
+// converted through a table per code page that is built on first use, with
+// ASCII copied as is.  Anything else goes through an iconv descriptor that is
+// kept open for the codeset rather than being opened for every string.  Output
+// is collected in a buffer that is reused from one string to the next.
+class TextDecoder
+{
+private:
+	typedef std::vector<gunichar> CodePage;
+
+	// Codesets are either literals or the configured encoding, so they are
+	// looked up by address and a lookup never allocates
+	String								encoding;
+	std::map<const gchar*, GIConv>		converters;
+	std::map<const gchar*, CodePage>	code_pages;
+	std::vector<gchar>					input;
+	std::vector<gchar>					output;
+
+	const gchar* get_codeset(const guchar*& text, const guchar* end);
+	GIConv get_converter(const gchar* codeset);
+	const CodePage* get_code_page(const gchar* codeset);
+	gboolean decode_code_page(String& s, const CodePage* code_page, const guchar* text, const guchar* end);
+	void decode_iconv(String& s, const gchar* codeset, const guchar* text, const guchar* end);
+
+	TextDecoder(const TextDecoder&);
+	TextDecoder& operator=(const TextDecoder&);
+
+public:
+	TextDecoder(const String& encoding);
+	~TextDecoder();
+
+	gsize decode(String& s, const guchar* buffer);
+};
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "timeshift_buffer.h"
+#include "mpeg_stream.h"
+#include "exception.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+TimeshiftBuffer::TimeshiftBuffer(guint64 s)
+{
+	// Keep whole packets at the wrap point
+	size = s - (s % TS_PACKET_SIZE);
+	write_position = 0;
+	start_time = g_get_monotonic_time();
+
+	String path = Glib::build_filename(Glib::get_tmp_dir(), "me-tv-timeshift-XXXXXX");
+	gchar* filename = g_strdup(path.c_str());
+	fd = g_mkstemp(filename);
+	if (fd < 0)
+	{
+		g_free(filename);
+		throw SystemException(_("Failed to create time-shift buffer"));
+	}
+
+	// Nobody else needs to see the file, it goes away when it is closed
+	unlink(filename);
+	g_free(filename);
+
+	if (fallocate(fd, 0, 0, size) < 0)
+	{
+		g_debug("Failed to preallocate time-shift buffer, continuing without");
+	}
+}
+
+TimeshiftBuffer::~TimeshiftBuffer()
+{
+	::close(fd);
+}
+
+void TimeshiftBuffer::write(const guchar* buffer, gsize length)
+{
+	while (length > 0)
+	{
+		guint64 offset = write_position % size;
+		gsize count = MIN(length, size - offset);
+
+		gssize result = pwrite(fd, buffer, count, offset);
+		if (result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			throw SystemException(_("Failed to write time-shift buffer"));
+		}
+
+		write_position += result;
+		buffer += result;
+		length -= result;
+	}
+}
+
+// Reads from position, moving it forward past the data read.  A position that has
+// already been overwritten is moved up to the oldest data still held.
+gsize TimeshiftBuffer::read(guint64& position, guchar* buffer, gsize length)
+{
+	if (position < get_oldest_position())
+	{
+		position = get_oldest_position();
+	}
+
+	length = MIN((guint64)length, write_position - position);
+
+	gsize total = 0;
+	while (total < length)
+	{
+		guint64 offset = position % size;
+		gsize count = MIN((guint64)(length - total), size - offset);
+
+		gssize result = pread(fd, buffer + total, count, offset);
+		if (result <= 0)
+		{
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			throw SystemException(_("Failed to read time-shift buffer"));
+		}
+
+		position += result;
+		total += result;
+	}
+
+	return total;
+}
+
+guint64 TimeshiftBuffer::get_byte_rate() const
+{
+	gint64 elapsed = g_get_monotonic_time() - start_time;
+	return elapsed > 0 ? write_position * 1000000 / elapsed : 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __TIMESHIFT_BUFFER_H__
+#define __TIMESHIFT_BUFFER_H__
+
+#include "me-tv-types.h"
+
+// A preallocated circular file holding the last few minutes of a stream.  Positions
+// are logical byte counts since the buffer was created, the oldest position still
+// held is get_write_position() - get_size().
+class TimeshiftBuffer
+{
+private:
+	int			fd;
+	guint64		size;
+	guint64		write_position;
+	gint64		start_time;
+
+public:
+	TimeshiftBuffer(guint64 size);
+	~TimeshiftBuffer();
+
+	void write(const guchar* buffer, gsize length);
+	gsize read(guint64& position, guchar* buffer, gsize length);
+
+	guint64 get_size() const { return size; }
+	guint64 get_write_position() const { return write_position; }
+	guint64 get_oldest_position() const { return write_position > size ? write_position - size : 0; }
+	guint64 get_byte_rate() const;
+};
+
+#endif
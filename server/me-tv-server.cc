@@ -54,6 +54,7 @@ int main(int argc, char** argv)
 
 		broadcast_address = "127.0.0.1";
 		gint server_port = 1999;
+		gint http_port = 0;
 		String server_host;
 
 		Glib::OptionEntry verbose_option_entry;
@@ -77,17 +78,62 @@ int main(int argc, char** argv)
 		broadcast_address_option_entry.set_long_name("broadcast-address");
 		broadcast_address_option_entry.set_description(_("The network broadcast address to send video streams for clients to display (default 127.0.0.1)."));
 
+		Glib::OptionEntry multicast_address_option_entry;
+		multicast_address_option_entry.set_long_name("multicast-address");
+		multicast_address_option_entry.set_description(_("The multicast group to send shared video streams to for clients that ask for multicast (default none)."));
+
+		Glib::OptionEntry multicast_interface_option_entry;
+		multicast_interface_option_entry.set_long_name("multicast-interface");
+		multicast_interface_option_entry.set_description(_("The network interface, by name or address, to send multicast streams on (default chosen by the routing table)."));
+
+		Glib::OptionEntry multicast_ttl_option_entry;
+		multicast_ttl_option_entry.set_long_name("multicast-ttl");
+		multicast_ttl_option_entry.set_description(_("The time to live of multicast streams, the number of routers they may cross (default 1)."));
+
+		Glib::OptionEntry pace_output_option_entry;
+		pace_output_option_entry.set_long_name("pace-output");
+		pace_output_option_entry.set_description(_("Send broadcast streams at their real bitrate, timed from the PCR, instead of in bursts."));
+
+		Glib::OptionEntry recording_sync_interval_option_entry;
+		recording_sync_interval_option_entry.set_long_name("recording-sync-interval");
+		recording_sync_interval_option_entry.set_description(_("Force recordings to disk after this many megabytes have been written (default 0, leave it to the kernel)."));
+
+		Glib::OptionEntry timeshift_size_option_entry;
+		timeshift_size_option_entry.set_long_name("timeshift-size");
+		timeshift_size_option_entry.set_description(_("Size in megabytes of the time-shift buffer kept for each broadcast (default 0, no time-shifting)."));
+
+		Glib::OptionEntry segment_duration_option_entry;
+		segment_duration_option_entry.set_long_name("segment-duration");
+		segment_duration_option_entry.set_description(_("Split recordings into segments of about this many seconds, listed in a playlist (default 0, one file)."));
+
+		Glib::OptionEntry segment_size_option_entry;
+		segment_size_option_entry.set_long_name("segment-size");
+		segment_size_option_entry.set_description(_("Split recordings into segments of about this many megabytes, listed in a playlist (default 0, one file)."));
+
 		Glib::OptionEntry server_port_option_entry;
 		server_port_option_entry.set_long_name("server-port");
 		server_port_option_entry.set_description(_("The network port for clients to connect to (default 1999)."));
 
+		Glib::OptionEntry http_port_option_entry;
+		http_port_option_entry.set_long_name("http-port");
+		http_port_option_entry.set_description(_("The network port for HTTP streaming of channels and recordings. It has no authentication, so it is disabled unless a port is given (default 0)."));
+
 		Glib::OptionGroup option_group(PACKAGE_NAME, "", _("Show Me TV Client help options"));
 		option_group.add_entry(verbose_option_entry, verbose_logging);
 		option_group.add_entry(disable_epg_thread_option_entry, disable_epg_thread);
 		option_group.add_entry(devices_option_entry, devices);
 		option_group.add_entry(read_timeout_option_entry, read_timeout);
 		option_group.add_entry(broadcast_address_option_entry, broadcast_address);
+		option_group.add_entry(multicast_address_option_entry, multicast_address);
+		option_group.add_entry(multicast_interface_option_entry, multicast_interface);
+		option_group.add_entry(multicast_ttl_option_entry, multicast_ttl);
+		option_group.add_entry(pace_output_option_entry, pace_output);
+		option_group.add_entry(recording_sync_interval_option_entry, recording_sync_interval);
+		option_group.add_entry(timeshift_size_option_entry, timeshift_size);
+		option_group.add_entry(segment_duration_option_entry, segment_duration);
+		option_group.add_entry(segment_size_option_entry, segment_size);
 		option_group.add_entry(server_port_option_entry, server_port);
+		option_group.add_entry(http_port_option_entry, http_port);
 
 		Glib::OptionContext option_context;
 		option_context.set_summary(ME_TV_SUMMARY);
@@ -96,7 +142,7 @@ int main(int argc, char** argv)
 
 		option_context.parse(argc, argv);
 
-		Server server(server_port);
+		Server server(server_port, http_port);
 		server.start();
 
 		g_message("Me TV Server entering main loop");
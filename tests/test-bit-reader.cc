@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+// Compares BitReader with the bit-at-a-time extraction that it replaced, on
+// random sections, and reports how long each takes
+
+#include "test-common.h"
+#include "bit_reader.h"
+#include <vector>
+
+#define SECTION_LENGTH	1024
+#define SECTION_COUNT	64
+#define TIMING_ROUNDS	20
+
+// The original Buffer::get_bits()
+static guint get_bits_by_bit(const guchar* buffer, guint position, gsize count)
+{
+	gsize val = 0;
+
+	for (gsize i = position; i < count + position; i++)
+	{
+		val = val << 1;
+		val = val + ((buffer[i >> 3] & (0x80 >> (i & 7))) ? 1 : 0);
+	}
+	
+	return val;
+}
+
+static std::vector<guchar> make_random_section(GRand* rand)
+{
+	std::vector<guchar> section(SECTION_LENGTH);
+	for (gsize i = 0; i < section.size(); i++)
+	{
+		section[i] = g_rand_int_range(rand, 0, 256);
+	}
+	return section;
+}
+
+// Every width at every bit offset, including fields that end on the last byte
+static void test_all_fields(const std::vector<guchar>& section)
+{
+	const guchar* data = &section[0];
+	guint bit_length = section.size() * 8;
+
+	for (guint count = 1; count <= 32; count++)
+	{
+		for (guint position = 0; position + count <= bit_length; position++)
+		{
+			check(BitReader::get_bits(data, position, count) == get_bits_by_bit(data, position, count),
+				"get_bits (position %u, count %u)", position, count);
+		}
+	}
+}
+
+template<guint position, guint count>
+static void test_fixed_field(const std::vector<guchar>& section)
+{
+	for (guint offset = 0; offset + (position + count + 7) / 8 <= section.size(); offset += 13)
+	{
+		const guchar* data = &section[offset];
+		check(BitReader::get_bits<position, count>(data) == get_bits_by_bit(data, position, count),
+			"fixed get_bits (position %u, count %u)", position, count);
+	}
+}
+
+// The fields read from fixed positions in dvb_si.cc and mpeg_stream.cc, and the
+// widths and shifts around them
+static void test_fixed_fields(const std::vector<guchar>& section)
+{
+	test_fixed_field<0, 1>(section);
+	test_fixed_field<0, 8>(section);
+	test_fixed_field<0, 16>(section);
+	test_fixed_field<0, 24>(section);
+	test_fixed_field<0, 32>(section);
+	test_fixed_field<3, 13>(section);
+	test_fixed_field<4, 12>(section);
+	test_fixed_field<6, 2>(section);
+	test_fixed_field<7, 25>(section);
+	test_fixed_field<7, 32>(section);
+	test_fixed_field<12, 4>(section);
+	test_fixed_field<16, 16>(section);
+	test_fixed_field<20, 12>(section);
+	test_fixed_field<26, 5>(section);
+	test_fixed_field<31, 1>(section);
+	test_fixed_field<40, 24>(section);
+}
+
+static void report_timing(const std::vector<guchar>& section)
+{
+	const guchar* data = &section[0];
+	guint bit_length = section.size() * 8 - 32;
+	guint total = 0;
+
+	gint64 start = g_get_monotonic_time();
+	for (guint round = 0; round < TIMING_ROUNDS; round++)
+	{
+		for (guint position = 0; position < bit_length; position += 3)
+		{
+			total += get_bits_by_bit(data, position, (position % 32) + 1);
+		}
+	}
+	gint64 by_bit = g_get_monotonic_time() - start;
+
+	start = g_get_monotonic_time();
+	for (guint round = 0; round < TIMING_ROUNDS; round++)
+	{
+		for (guint position = 0; position < bit_length; position += 3)
+		{
+			total -= BitReader::get_bits(data, position, (position % 32) + 1);
+		}
+	}
+	gint64 by_word = g_get_monotonic_time() - start;
+
+	check(total == 0, "timing totals");
+	g_print("Bit at a time: %" G_GINT64_FORMAT "us, word at a time: %" G_GINT64_FORMAT "us\n", by_bit, by_word);
+}
+
+int main(int argc, char** argv)
+{
+	GRand* rand = g_rand_new_with_seed(TEST_RANDOM_SEED);
+
+	for (guint i = 0; i < SECTION_COUNT; i++)
+	{
+		std::vector<guchar> section = make_random_section(rand);
+		if (i < 4)
+		{
+			test_all_fields(section);
+		}
+		test_fixed_fields(section);
+	}
+
+	report_timing(make_random_section(rand));
+
+	g_rand_free(rand);
+
+	return report_failures("bit reader");
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef __TEST_COMMON_H__
+#define __TEST_COMMON_H__
+
+// Shared by the check programs, each of which is a single source file
+
+#include <glib.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+// Random test data is the same on every run
+#define TEST_RANDOM_SEED	0x4D455456
+
+static guint test_failures = 0;
+
+G_GNUC_PRINTF(2, 3)
+static inline void check(gboolean condition, const gchar* format, ...)
+{
+	if (condition)
+	{
+		return;
+	}
+
+	va_list arguments;
+	va_start(arguments, format);
+	gchar* description = g_strdup_vprintf(format, arguments);
+	va_end(arguments);
+
+	g_printerr("FAIL: %s\n", description);
+	g_free(description);
+	test_failures++;
+}
+
+// The exit status of the program
+static inline int report_failures(const gchar* name)
+{
+	if (test_failures > 0)
+	{
+		g_printerr("%u %s checks failed\n", test_failures, name);
+		return 1;
+	}
+
+	return 0;
+}
+
+#endif
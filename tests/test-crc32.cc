@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+// Known answers for each CRC32 implementation at short, unaligned and long
+// lengths, worked out independently of Me TV, and how long each takes on
+// section sized and large buffers
+
+#include "test-common.h"
+#include "crc32.h"
+#include <string.h>
+
+#define PATTERN_LENGTH	4096
+#define SECTION_SIZE	1024
+#define LARGE_SIZE		(1024 * 1024)
+#define TIMING_BYTES	(256 * 1024 * 1024)
+
+typedef struct
+{
+	gsize	length;
+	guint32	crc;
+} KnownAnswer;
+
+// CRC-32/MPEG-2 of the first length bytes of the pattern (i * 31 + 7) & 0xFF,
+// covering the byte-wise tail, the 8 byte slicing steps and the 64 byte folding
+// steps
+static const KnownAnswer pattern_answers[] =
+{
+	{ 0, 0xffffffff },
+	{ 1, 0x504fefb1 },
+	{ 3, 0x5459a809 },
+	{ 7, 0xc6465c28 },
+	{ 8, 0xc4f9d352 },
+	{ 9, 0x06aaf4f1 },
+	{ 15, 0x69f3fca4 },
+	{ 16, 0x4a0334c9 },
+	{ 17, 0x8fc7c2ad },
+	{ 63, 0xc129975e },
+	{ 64, 0xa7fb6898 },
+	{ 65, 0x57cd5e97 },
+	{ 127, 0x5860c19b },
+	{ 128, 0xb4f3f690 },
+	{ 129, 0x2a87db49 },
+	{ 188, 0xc511330a },
+	{ 1000, 0xbabf9215 },
+	{ 4096, 0x64bceddd }
+};
+
+static void test_implementation(const gchar* name)
+{
+	// Copied to every alignment within 16 bytes
+	static guchar buffer[PATTERN_LENGTH + 16];
+
+	const guchar check_string[] = "123456789";
+	check(Crc32::calculate(check_string, 9) == 0x0376e6e7, "%s check value", name);
+
+	for (gsize alignment = 0; alignment < 16; alignment++)
+	{
+		guchar* data = buffer + alignment;
+		for (gsize i = 0; i < PATTERN_LENGTH; i++)
+		{
+			data[i] = (i * 31 + 7) & 0xFF;
+		}
+
+		for (gsize i = 0; i < G_N_ELEMENTS(pattern_answers); i++)
+		{
+			const KnownAnswer& answer = pattern_answers[i];
+			check(Crc32::calculate(data, answer.length) == answer.crc,
+				"%s pattern (alignment %" G_GSIZE_FORMAT ", length %" G_GSIZE_FORMAT ")", name, alignment, answer.length);
+		}
+
+		// A section followed by its CRC leaves no remainder
+		gsize length = 183;
+		guint32 crc = Crc32::calculate(data, length);
+		data[length] = crc >> 24;
+		data[length + 1] = (crc >> 16) & 0xFF;
+		data[length + 2] = (crc >> 8) & 0xFF;
+		data[length + 3] = crc & 0xFF;
+		check(Crc32::calculate(data, data + length + 4) == 0,
+			"%s section remainder (alignment %" G_GSIZE_FORMAT ")", name, alignment);
+	}
+
+	guchar zeros[64];
+	memset(zeros, 0, sizeof(zeros));
+	check(Crc32::calculate(zeros, sizeof(zeros)) == 0x93394e51, "%s zeros", name);
+
+	guchar ones[64];
+	memset(ones, 0xFF, sizeof(ones));
+	check(Crc32::calculate(ones, sizeof(ones)) == 0xa21e790f, "%s ones", name);
+}
+
+static volatile guint32 timing_sink;
+
+// Throughput in MB/s over the same number of bytes for each buffer size
+static guint64 measure_rate(const guchar* data, gsize length)
+{
+	guint32 total = 0;
+	guint count = TIMING_BYTES / length;
+
+	gint64 start = g_get_monotonic_time();
+	for (guint i = 0; i < count; i++)
+	{
+		total ^= Crc32::calculate(data, length);
+	}
+	gint64 elapsed = MAX(g_get_monotonic_time() - start, (gint64)1);
+
+	// Keeps the loop from being optimised away
+	timing_sink = total;
+
+	return (guint64)count * length / elapsed;
+}
+
+static void report_timing(const gchar* name)
+{
+	static guchar buffer[LARGE_SIZE];
+	for (gsize i = 0; i < sizeof(buffer); i++)
+	{
+		buffer[i] = (i * 31 + 7) & 0xFF;
+	}
+
+	guint64 section_rate = measure_rate(buffer, SECTION_SIZE);
+	guint64 large_rate = measure_rate(buffer, LARGE_SIZE);
+
+	g_print("%s: %" G_GUINT64_FORMAT " MB/s on %d byte sections, %" G_GUINT64_FORMAT " MB/s on 1MB buffers\n",
+		name, section_rate, SECTION_SIZE, large_rate);
+}
+
+int main(int argc, char** argv)
+{
+	Crc32::init();
+
+	Crc32::set_implementation(Crc32::IMPLEMENTATION_BYTEWISE);
+	test_implementation("byte-wise");
+	report_timing("byte-wise");
+
+	Crc32::set_implementation(Crc32::IMPLEMENTATION_SLICED);
+	test_implementation("slicing-by-8");
+	report_timing("slicing-by-8");
+
+	if (Crc32::set_implementation(Crc32::IMPLEMENTATION_CLMUL))
+	{
+		test_implementation("PCLMULQDQ");
+		report_timing("PCLMULQDQ");
+	}
+	else
+	{
+		g_print("PCLMULQDQ is not available, not tested\n");
+	}
+
+	return report_failures("CRC32");
+}
@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+// Feeds sections split across transport stream packets to Dvb::SectionFilter
+
+#include "test-common.h"
+#include "dvb_section_filter.h"
+#include "dvb_si.h"
+#include "crc32.h"
+#include <string.h>
+#include <algorithm>
+
+#define TEST_PID	0x100
+
+typedef std::vector<guchar> Bytes;
+
+// A long syntax section with a valid CRC
+static Bytes make_section(guint table_id, guint extension, guint version, guint section_number, gsize payload_length)
+{
+	gsize length = 8 + payload_length + 4;
+	Bytes section(length);
+
+	section[0] = table_id;
+	section[1] = 0xB0 | (((length - 3) >> 8) & 0x0F);
+	section[2] = (length - 3) & 0xFF;
+	section[3] = extension >> 8;
+	section[4] = extension & 0xFF;
+	section[5] = 0xC1 | ((version & 0x1F) << 1);
+	section[6] = section_number;
+	section[7] = section_number;
+	for (gsize i = 0; i < payload_length; i++)
+	{
+		section[8 + i] = (i * 7 + section_number) & 0xFF;
+	}
+
+	guint32 crc = Crc32::calculate(&section[0], length - 4);
+	section[length - 4] = crc >> 24;
+	section[length - 3] = (crc >> 16) & 0xFF;
+	section[length - 2] = (crc >> 8) & 0xFF;
+	section[length - 1] = crc & 0xFF;
+
+	return section;
+}
+
+// Splits sections into packets the way a multiplexer does: a packet in which a
+// section starts has the payload unit start indicator and a pointer field, and
+// the rest of a packet after the last section is stuffed with 0xFF
+class Packetizer
+{
+private:
+	guint continuity_counter;
+	guint adaptation_length;
+
+public:
+	Packetizer(guint a = 0) : continuity_counter(0), adaptation_length(a) {}
+
+	std::vector<Bytes> packets;
+
+	void write(const std::vector<Bytes>& sections)
+	{
+		Bytes stream;
+		std::vector<gsize> starts;
+		for (std::vector<Bytes>::const_iterator i = sections.begin(); i != sections.end(); i++)
+		{
+			starts.push_back(stream.size());
+			stream.insert(stream.end(), i->begin(), i->end());
+		}
+
+		gsize position = 0;
+		while (position < stream.size())
+		{
+			Bytes packet(TS_PACKET_SIZE, 0xFF);
+			gsize offset = 4;
+
+			packet[0] = 0x47;
+			packet[1] = (TEST_PID >> 8) & 0x1F;
+			packet[2] = TEST_PID & 0xFF;
+			packet[3] = 0x10 | (continuity_counter++ & 0x0F);
+
+			if (adaptation_length > 0)
+			{
+				packet[3] |= 0x20;
+				packet[4] = adaptation_length;
+				packet[5] = 0x00;
+				offset += adaptation_length + 1;
+			}
+
+			gsize space = TS_PACKET_SIZE - offset;
+			gsize start = 0;
+			gboolean has_start = false;
+			for (std::vector<gsize>::iterator i = starts.begin(); i != starts.end() && !has_start; i++)
+			{
+				if (*i >= position && *i < position + space - 1)
+				{
+					start = *i;
+					has_start = true;
+				}
+			}
+
+			gsize count = space;
+			if (has_start)
+			{
+				packet[1] |= 0x40;
+				packet[offset++] = start - position;
+				count = space - 1;
+			}
+			else if (std::find(starts.begin(), starts.end(), position + space - 1) != starts.end())
+			{
+				// A section cannot start in a packet without a pointer field
+				count = space - 1;
+			}
+
+			count = MIN(count, stream.size() - position);
+			memcpy(&packet[offset], &stream[position], count);
+			position += count;
+
+			packets.push_back(packet);
+		}
+	}
+
+	void write(const Bytes& section)
+	{
+		write(std::vector<Bytes>(1, section));
+	}
+};
+
+class Receiver
+{
+public:
+	std::vector<Bytes> sections;
+
+	void on_section(guint pid, const Buffer& section)
+	{
+		sections.push_back(Bytes(section.get_buffer(), section.get_buffer() + section.get_length()));
+	}
+};
+
+static void push(Dvb::SectionFilter& filter, const std::vector<Bytes>& packets)
+{
+	for (std::vector<Bytes>::const_iterator i = packets.begin(); i != packets.end(); i++)
+	{
+		filter.push(&(*i)[0]);
+	}
+}
+
+static void test_multiple_packets()
+{
+	Dvb::SectionFilter filter;
+	Receiver receiver;
+	filter.add(TEST_PID, PMT_ID, 0xFF, false, sigc::mem_fun(receiver, &Receiver::on_section));
+
+	Bytes section = make_section(PMT_ID, 1, 0, 0, 500);
+	Packetizer packetizer;
+	packetizer.write(section);
+
+	check(packetizer.packets.size() == 3, "a 512 byte section takes three packets");
+	push(filter, packetizer.packets);
+	check(receiver.sections.size() == 1 && receiver.sections[0] == section, "section split across packets is reassembled");
+}
+
+static void test_pointer_field()
+{
+	Dvb::SectionFilter filter;
+	Receiver receiver;
+	filter.add(TEST_PID, PMT_ID, 0xFF, false, sigc::mem_fun(receiver, &Receiver::on_section));
+
+	std::vector<Bytes> sections;
+	sections.push_back(make_section(PMT_ID, 1, 0, 0, 300));
+	sections.push_back(make_section(PMT_ID, 2, 0, 0, 300));
+	sections.push_back(make_section(PMT_ID, 3, 0, 0, 20));
+
+	Packetizer packetizer;
+	packetizer.write(sections);
+
+	check(packetizer.packets[1][1] & 0x40, "second packet starts a section");
+	check(packetizer.packets[1][4] > 0, "second packet has a non-zero pointer field");
+
+	push(filter, packetizer.packets);
+	check(receiver.sections == sections, "sections around a pointer field are reassembled in order");
+}
+
+static void test_stuffing()
+{
+	Dvb::SectionFilter filter;
+	Receiver receiver;
+	filter.add(TEST_PID, PMT_ID, 0xFF, false, sigc::mem_fun(receiver, &Receiver::on_section));
+
+	std::vector<Bytes> sections;
+	for (guint i = 0; i < 4; i++)
+	{
+		sections.push_back(make_section(PMT_ID, i, 0, 0, 20));
+	}
+
+	Packetizer packetizer;
+	packetizer.write(sections);
+	packetizer.write(make_section(PMT_ID, 9, 0, 0, 20));
+
+	check(packetizer.packets.size() == 2, "short sections share a packet");
+	check(packetizer.packets[0][TS_PACKET_SIZE - 1] == 0xFF, "first packet ends with stuffing");
+
+	push(filter, packetizer.packets);
+	sections.push_back(make_section(PMT_ID, 9, 0, 0, 20));
+	check(receiver.sections == sections, "several sections in a packet and stuffing after them");
+}
+
+static void test_adaptation_field()
+{
+	Dvb::SectionFilter filter;
+	Receiver receiver;
+	filter.add(TEST_PID, PMT_ID, 0xFF, false, sigc::mem_fun(receiver, &Receiver::on_section));
+
+	Bytes section = make_section(PMT_ID, 1, 0, 0, 400);
+	Packetizer packetizer(10);
+	packetizer.write(section);
+
+	push(filter, packetizer.packets);
+	check(receiver.sections.size() == 1 && receiver.sections[0] == section, "section in packets with an adaptation field");
+}
+
+static void test_continuity()
+{
+	Dvb::SectionFilter filter;
+	Receiver receiver;
+	filter.add(TEST_PID, PMT_ID, 0xFF, false, sigc::mem_fun(receiver, &Receiver::on_section));
+
+	Bytes lost = make_section(PMT_ID, 1, 0, 0, 500);
+	Bytes next = make_section(PMT_ID, 2, 0, 0, 100);
+	Packetizer packetizer;
+	packetizer.write(lost);
+	packetizer.write(next);
+
+	// A repeated packet is ignored, a missing one drops the section
+	std::vector<Bytes> packets = packetizer.packets;
+	packets.insert(packets.begin() + 1, packets[0]);
+	packets.erase(packets.begin() + 2);
+
+	push(filter, packets);
+	check(receiver.sections.size() == 1 && receiver.sections[0] == next, "a section with a missing packet is dropped");
+
+	Receiver duplicate_receiver;
+	Dvb::SectionFilter duplicate_filter;
+	duplicate_filter.add(TEST_PID, PMT_ID, 0xFF, false, sigc::mem_fun(duplicate_receiver, &Receiver::on_section));
+
+	packets = packetizer.packets;
+	packets.insert(packets.begin() + 1, packets[0]);
+	push(duplicate_filter, packets);
+	check(duplicate_receiver.sections.size() == 2 && duplicate_receiver.sections[0] == lost, "a repeated packet is ignored");
+}
+
+static void test_crc()
+{
+	Dvb::SectionFilter filter;
+	Receiver receiver;
+	filter.add(TEST_PID, PMT_ID, 0xFF, false, sigc::mem_fun(receiver, &Receiver::on_section));
+
+	Bytes section = make_section(PMT_ID, 1, 0, 0, 200);
+	section[100] ^= 0x01;
+	Packetizer packetizer;
+	packetizer.write(section);
+
+	push(filter, packetizer.packets);
+	check(receiver.sections.empty(), "a section that fails its CRC is dropped");
+}
+
+static void test_deduplicate()
+{
+	Dvb::SectionFilter filter;
+	Receiver all;
+	Receiver changes;
+	filter.add(TEST_PID, PMT_ID, 0xFF, false, sigc::mem_fun(all, &Receiver::on_section));
+	filter.add(TEST_PID, PMT_ID, 0xFF, true, sigc::mem_fun(changes, &Receiver::on_section));
+
+	Packetizer packetizer;
+	packetizer.write(make_section(PMT_ID, 1, 0, 0, 50));
+	packetizer.write(make_section(PMT_ID, 1, 0, 0, 50));
+	packetizer.write(make_section(PMT_ID, 1, 1, 0, 50));
+	packetizer.write(make_section(PMT_ID, 1, 1, 1, 50));
+
+	push(filter, packetizer.packets);
+	check(all.sections.size() == 4, "every section is delivered without deduplication");
+	check(changes.sections.size() == 3, "a repeated version of a section is delivered once");
+}
+
+static void test_table_mask()
+{
+	Dvb::SectionFilter filter;
+	Receiver receiver;
+	filter.add(TEST_PID, 0x50, 0xF0, false, sigc::mem_fun(receiver, &Receiver::on_section));
+
+	Packetizer packetizer;
+	packetizer.write(make_section(0x4E, 1, 0, 0, 50));
+	packetizer.write(make_section(0x50, 1, 0, 0, 50));
+	packetizer.write(make_section(0x5F, 1, 0, 0, 50));
+
+	push(filter, packetizer.packets);
+	check(receiver.sections.size() == 2, "table IDs are matched under the mask");
+}
+
+int main(int argc, char** argv)
+{
+	Crc32::init();
+
+	test_multiple_packets();
+	test_pointer_field();
+	test_stuffing();
+	test_adaptation_field();
+	test_continuity();
+	test_crc();
+	test_deduplicate();
+	test_table_mask();
+
+	return report_failures("section filter");
+}
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2011 Michael Lamothe
+ *
+ * This file is part of Me TV
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+// Compares TextDecoder with the g_convert() based decoding that it replaced, on
+// random DVB strings in each character table, and reports how long each takes
+
+#include "test-common.h"
+#include "text_decoder.h"
+#include "exception.h"
+#include <vector>
+
+#define STRING_COUNT	200
+#define TIMING_STRINGS	20000
+
+typedef std::vector<guchar> Bytes;
+
+// The original SectionParser::get_text(), without ISO 6937
+static gsize decode_by_g_convert(String& s, const guchar* text_buffer, const String& text_encoding)
+{
+	gsize length = text_buffer[0];
+	guint text_index = 0;
+	gchar text[length];
+	guint index = 0;
+	const gchar* codeset = "ISO-8859-15";
+	
+	if (length > 0)
+	{
+		// Skip over length byte
+		index++;
+
+		if (text_encoding.length() > 0 && text_encoding != "auto")
+		{
+			codeset = text_encoding.c_str();
+		}
+		else // Determine codeset from stream
+		{			
+			if (text_buffer[index] < 0x20)
+			{
+				switch (text_buffer[index])
+				{
+				case 0x01: codeset = "ISO-8859-5"; break;
+				case 0x02: codeset = "ISO-8859-6"; break;
+				case 0x03: codeset = "ISO-8859-7"; break;
+				case 0x04: codeset = "ISO-8859-8"; break;
+				case 0x05: codeset = "ISO-8859-9"; break;
+				case 0x06: codeset = "ISO-8859-10"; break;
+				case 0x07: codeset = "ISO-8859-11"; break;
+				case 0x08: codeset = "ISO-8859-12"; break;
+				case 0x09: codeset = "ISO-8859-13"; break;
+				case 0x0A: codeset = "ISO-8859-14"; break;
+				case 0x0B: codeset = "ISO-8859-15"; break;
+				case 0x11: codeset = "UTF-16BE"; break;
+				case 0x14: codeset = "UTF-16BE"; break;
+
+				case 0x10:
+					{
+						// Skip 0x00
+						index++;
+						index++;
+						
+						switch(text_buffer[index])
+						{
+						case 0x01: codeset = "ISO-8859-1"; break;
+						case 0x02: codeset = "ISO-8859-2"; break;
+						case 0x03: codeset = "ISO-8859-3"; break;
+						case 0x04: codeset = "ISO-8859-4"; break;
+						case 0x05: codeset = "ISO-8859-5"; break;
+						case 0x06: codeset = "ISO-8859-6"; break;
+						case 0x07: codeset = "ISO-8859-7"; break;
+						case 0x08: codeset = "ISO-8859-8"; break;
+						case 0x09: codeset = "ISO-8859-9"; break;
+						case 0x0A: codeset = "ISO-8859-10"; break;
+						case 0x0B: codeset = "ISO-8859-11"; break;
+						case 0x0C: codeset = "ISO-8859-12"; break;
+						case 0x0D: codeset = "ISO-8859-13"; break;
+						case 0x0E: codeset = "ISO-8859-14"; break;
+						case 0x0F: codeset = "ISO-8859-15"; break;
+						default: break;
+						}
+					}
+					default: break;
+				}
+				
+				index++;
+			}
+		}
+		
+		if (index < (length + 1))
+		{
+			while (index < (length + 1))
+			{
+				guchar ch = text_buffer[index];
+
+				if (strcmp(codeset, "UTF-16BE") == 0)
+				{
+					text[text_index++] = ch;
+				}
+				else
+				{
+					if (ch == 0x86 || ch == 0x87)
+					{
+						// Ignore formatting
+					}
+					else if (ch == 0x8A)
+					{
+						text[text_index++] = '\n';
+					}
+					else if (ch >= 0x80 && ch < 0xA0)
+					{
+						text[text_index++] = '.';
+					}
+					else
+					{
+						text[text_index++] = ch;
+					}
+				}
+				
+				index++;
+			}
+			
+			gsize bytes_read;
+			gsize bytes_written;
+			GError* error = NULL;
+			
+			gchar* result = g_convert(
+				text,
+				text_index,
+				"UTF-8",
+				codeset,
+				&bytes_read,
+				&bytes_written,
+				&error);
+			
+			if (error != NULL || result == NULL)
+			{
+				if (error != NULL)
+				{
+					g_error_free(error);
+				}
+				throw Exception("Failed to convert to UTF-8");
+			}
+			
+			s += result;
+			g_free(result);
+		}
+	}
+	
+	return length + 1;
+}
+
+// Text with ASCII, the 0x80 to 0x9F control codes and the upper half of the
+// code page, after the given table selection bytes
+static Bytes make_single_byte_string(GRand* rand, const Bytes& prefix)
+{
+	Bytes result(1, 0);
+	result.insert(result.end(), prefix.begin(), prefix.end());
+
+	gsize length = g_rand_int_range(rand, 0, 200);
+	for (gsize i = 0; i < length; i++)
+	{
+		switch (g_rand_int_range(rand, 0, 4))
+		{
+		case 0:
+			result.push_back(g_rand_int_range(rand, 0x80, 0xA0));
+			break;
+
+		case 1:
+			result.push_back(g_rand_int_range(rand, 0xA0, 0x100));
+			break;
+
+		default:
+			result.push_back(g_rand_int_range(rand, 0x20, 0x80));
+			break;
+		}
+	}
+
+	result[0] = result.size() - 1;
+	return result;
+}
+
+// Characters from the basic multilingual plane, other than surrogates
+static Bytes make_utf16_string(GRand* rand, guchar selector)
+{
+	Bytes result(1, 0);
+	result.push_back(selector);
+
+	gsize length = g_rand_int_range(rand, 0, 120);
+	for (gsize i = 0; i < length; i++)
+	{
+		gunichar character = g_rand_int_range(rand, 0x20, 0xD800);
+		result.push_back(character >> 8);
+		result.push_back(character & 0xFF);
+	}
+
+	result[0] = result.size() - 1;
+	return result;
+}
+
+// Both either decode the string to the same text or fail
+static void compare(const Bytes& text, const String& encoding, TextDecoder& decoder, const gchar* description)
+{
+	String expected;
+	gsize expected_length = 0;
+	gboolean expected_failed = false;
+	try
+	{
+		expected_length = decode_by_g_convert(expected, &text[0], encoding);
+	}
+	catch(const Exception& exception)
+	{
+		expected_failed = true;
+	}
+
+	String actual;
+	gsize actual_length = 0;
+	gboolean actual_failed = false;
+	try
+	{
+		actual_length = decoder.decode(actual, &text[0]);
+	}
+	catch(const Exception& exception)
+	{
+		actual_failed = true;
+	}
+
+	check(expected_failed == actual_failed &&
+		(expected_failed || (expected == actual && expected_length == actual_length)),
+		"%s (length %u, selector 0x%02X)", description, text[0], text.size() > 1 ? text[1] : 0);
+}
+
+static void test_single_byte_tables(GRand* rand)
+{
+	TextDecoder decoder("auto");
+
+	for (guchar selector = 0x01; selector <= 0x0B; selector++)
+	{
+		for (guint i = 0; i < STRING_COUNT; i++)
+		{
+			compare(make_single_byte_string(rand, Bytes(1, selector)), "auto", decoder, "single byte table");
+		}
+	}
+
+	// No selection is ISO-8859-15
+	for (guint i = 0; i < STRING_COUNT; i++)
+	{
+		compare(make_single_byte_string(rand, Bytes()), "auto", decoder, "default table");
+	}
+}
+
+static void test_iso_8859_prefix(GRand* rand)
+{
+	TextDecoder decoder("auto");
+
+	for (guchar table = 0x01; table <= 0x0F; table++)
+	{
+		Bytes prefix;
+		prefix.push_back(0x10);
+		prefix.push_back(0x00);
+		prefix.push_back(table);
+
+		for (guint i = 0; i < STRING_COUNT; i++)
+		{
+			compare(make_single_byte_string(rand, prefix), "auto", decoder, "0x10 0x00 table");
+		}
+	}
+}
+
+static void test_configured_encoding(GRand* rand)
+{
+	TextDecoder decoder("ISO-8859-1");
+
+	for (guint i = 0; i < STRING_COUNT; i++)
+	{
+		compare(make_single_byte_string(rand, Bytes()), "ISO-8859-1", decoder, "configured encoding");
+	}
+}
+
+static void test_utf16(GRand* rand)
+{
+	TextDecoder decoder("auto");
+
+	for (guint i = 0; i < STRING_COUNT; i++)
+	{
+		compare(make_utf16_string(rand, 0x11), "auto", decoder, "UTF-16 0x11");
+		compare(make_utf16_string(rand, 0x14), "auto", decoder, "UTF-16 0x14");
+	}
+}
+
+static void test_empty()
+{
+	TextDecoder decoder("auto");
+
+	compare(Bytes(1, 0), "auto", decoder, "empty");
+	compare(Bytes(2, 1), "auto", decoder, "table selection only");
+}
+
+static void report_timing(GRand* rand)
+{
+	std::vector<Bytes> strings;
+	for (guint i = 0; i < TIMING_STRINGS; i++)
+	{
+		Bytes prefix;
+		if (i % 2 == 0)
+		{
+			prefix.push_back(0x05);
+		}
+
+		// ISO-8859-9 and ISO-8859-15 define every byte, so neither fails
+		strings.push_back(make_single_byte_string(rand, prefix));
+	}
+
+	String by_g_convert;
+	gint64 start = g_get_monotonic_time();
+	for (guint i = 0; i < TIMING_STRINGS; i++)
+	{
+		decode_by_g_convert(by_g_convert, &strings[i][0], "auto");
+	}
+	gint64 g_convert_time = g_get_monotonic_time() - start;
+
+	TextDecoder decoder("auto");
+	String by_decoder;
+	start = g_get_monotonic_time();
+	for (guint i = 0; i < TIMING_STRINGS; i++)
+	{
+		decoder.decode(by_decoder, &strings[i][0]);
+	}
+	gint64 decoder_time = g_get_monotonic_time() - start;
+
+	check(by_g_convert == by_decoder, "timing strings decoded the same");
+
+	g_print("g_convert: %" G_GINT64_FORMAT "us, TextDecoder: %" G_GINT64_FORMAT "us for %d strings\n",
+		g_convert_time, decoder_time, TIMING_STRINGS);
+}
+
+int main(int argc, char** argv)
+{
+	GRand* rand = g_rand_new_with_seed(TEST_RANDOM_SEED);
+
+	test_empty();
+	test_single_byte_tables(rand);
+	test_iso_8859_prefix(rand);
+	test_configured_encoding(rand);
+	test_utf16(rand);
+	report_timing(rand);
+
+	g_rand_free(rand);
+
+	return report_failures("text decoder");
+}